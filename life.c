@@ -2,6 +2,7 @@
  *            Conway's Game of Life.
  * AUTHOR:    Aaron Weeden, Shodor Education Foundation, Inc.
  * DATE:      January 2012
+ * BUILD:     gcc -O2 -fopenmp -pthread life.c -o life
  */
 
 /***********************
@@ -13,16 +14,51 @@
 #include <unistd.h>
 #include <omp.h>
 #include <time.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #define ALIVE 1
 #define DEAD 0
 
+/************************************************************
+ * Engines that can be selected on the command line with -e *
+ ************************************************************/
+#define ENGINE_SCALAR 0  /* one byte or word per cell, 3x3 neighbor loop */
+#define ENGINE_BITWISE 1 /* 64 cells per word, bit-sliced adders */
+#define ENGINE_HASHLIFE 2 /* memoized quadtree, unbounded plane */
+
+/***************************************************************
+ * Cell types that can be selected on the command line with -y *
+ ***************************************************************/
+#define CELL_UINT8 0
+#define CELL_UINT32 1
+#define CELL_BIT 2
+
+/* Number of cells packed into each word of a bit grid */
+#define BITS_PER_WORD 64
+
+/* Rows start on cache line boundaries */
+#define CACHE_LINE_SIZE 64
+
+/* Grids at least this large are backed by huge pages */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 /********************************************
  * Need at least this many rows and columns *
  ********************************************/
 const int MINIMUM_ROWS = 1;
 const int MINIMUM_COLUMNS = 1;
 const int MINIMUM_TIME_STEPS = 1;
+const int MINIMUM_THREADS = 1;
+const int MINIMUM_NODE_CACHE_MB = 1;
+const int MINIMUM_DEPTH = 1;
+const int MINIMUM_OUTPUT_INTERVAL = 1;
+const int MINIMUM_BAND_ROWS = 1;
+const int MAXIMUM_LOG2_STEP = 60;
 
 /*****************************************************
  * Add an "s" to the end of a value's name if needed *
@@ -74,224 +110,3129 @@ void exit_if(int boolean_expression, char function_name[32], int my_rank)
   return;
 }
 
-/****************
- * Main program *
- ****************/
-int main(int argc, char **argv)
+/*******************************************************************************
+ * A grid of cells stored in one contiguous buffer. Row 0 and row num_rows + 1
+ *  are the ghost rows, and column 0 and column num_cols + 1 are the ghost
+ *  columns. Every row starts on a cache line boundary, stride bytes after the
+ *  previous one. In a bit grid each row also has one zero word before and
+ *  after it so the stepper can always read the neighboring words.
+ ******************************************************************************/
+struct grid
 {
-  int NUM_ROWS = 5, NUM_COLS = 5, NUM_STEPS = 5, 
-      row, col, neighbor_row, neighbor_column,
-      num_alive_neighbors, c, return_value; 
-  int **current_grid, **next_grid;
-  int step;
+  int num_rows;
+  int num_cols;
+  int cell_type;
+  int words_per_row;  /* bit grids only */
+  size_t row_bytes;   /* bytes of cells in a row, including ghost columns */
+  size_t stride;
+  size_t size;
+  int is_mapped;      /* 1 if the buffer came from mmap(), 0 if malloc() */
+  unsigned char *buffer;
+};
 
-  /* Parse command line arguments */ 
-  while((c = getopt(argc, argv, "r:c:t:")) != -1)
+/*******************************************************************************
+ * Lay out a grid with room for the ghost rows and columns: set everything
+ *  but the buffer
+ ******************************************************************************/
+void layout_grid(struct grid *grid, int num_rows, int num_cols, int cell_type)
+{
+  grid->num_rows = num_rows;
+  grid->num_cols = num_cols;
+  grid->cell_type = cell_type;
+  grid->words_per_row = 0;
+  if(cell_type == CELL_BIT)
   {
-    switch(c)
+    grid->words_per_row = (num_cols + 2 + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    grid->row_bytes = grid->words_per_row * sizeof(uint64_t);
+    grid->stride = grid->row_bytes + 2 * sizeof(uint64_t);
+  }
+  else if(cell_type == CELL_UINT32)
+    grid->row_bytes = grid->stride = (num_cols + 2) * sizeof(uint32_t);
+  else
+    grid->row_bytes = grid->stride = (num_cols + 2) * sizeof(uint8_t);
+  grid->stride = (grid->stride + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE
+    * CACHE_LINE_SIZE;
+  grid->size = (num_rows + 2) * grid->stride;
+  grid->is_mapped = 0;
+  grid->buffer = NULL;
+
+  return;
+}
+
+/*******************************************************************************
+ * Allocate a grid with room for the ghost rows and columns. Large grids are
+ *  mapped with huge pages (falling back to transparent huge pages if none are
+ *  reserved) to cut TLB misses; small ones come from the heap. Either way
+ *  every cell starts out DEAD.
+ ******************************************************************************/
+void alloc_grid(struct grid *grid, int num_rows, int num_cols, int cell_type)
+{
+  size_t huge_size;
+
+  layout_grid(grid, num_rows, num_cols, cell_type);
+  if(grid->size >= HUGE_PAGE_SIZE)
+  {
+    huge_size = (grid->size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE
+      * HUGE_PAGE_SIZE;
+    grid->buffer = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(grid->buffer == MAP_FAILED)
     {
-      case 'r':
-        NUM_ROWS = atoi(optarg);
-        break;
-      case 'c':
-        NUM_COLS = atoi(optarg);
-        break;
-      case 't':
-        NUM_STEPS = atoi(optarg);
-        break;
-      case '?':
-      default:
-        fprintf(stderr, "Usage: %s [-r NUM_ROWS] [-c NUM_COLS] [-t NUM_STEPS]\n", argv[0]);
-        exit(-1);
+      grid->buffer = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      exit_if((grid->buffer == MAP_FAILED), "mmap(grid)", 0);
+      madvise(grid->buffer, huge_size, MADV_HUGEPAGE);
     }
+    grid->size = huge_size;
+    grid->is_mapped = 1;
+  }
+  else
+  {
+    exit_if((posix_memalign((void**)&grid->buffer, CACHE_LINE_SIZE,
+            grid->size) != 0), "posix_memalign(grid)", 0);
+    memset(grid->buffer, 0, grid->size);
   }
-  argc -= optind;
-  argv += optind;
 
-  /* Make sure we have enough rows, columns, and time steps */
-  return_value = assert_minimum_value("row", NUM_ROWS, MINIMUM_ROWS);
-  return_value += assert_minimum_value("column", NUM_COLS,
-      MINIMUM_COLUMNS);
-  return_value += assert_minimum_value("time step", NUM_STEPS,
-      MINIMUM_TIME_STEPS);
+  return;
+}
 
-  /* Exit if we don't */
-  if(return_value != 0)
+/*********************
+ * Deallocate a grid *
+ *********************/
+void free_grid(struct grid *grid)
+{
+  if(grid->is_mapped)
+    munmap(grid->buffer, grid->size);
+  else
+    free(grid->buffer);
+
+  return;
+}
+
+/************************************************************
+ * Return the first cell (or, in a bit grid, word) of a row *
+ ************************************************************/
+void *grid_row(struct grid *grid, int row)
+{
+  if(grid->cell_type == CELL_BIT)
+    return grid->buffer + (size_t)row * grid->stride + sizeof(uint64_t);
+  return grid->buffer + (size_t)row * grid->stride;
+}
+
+/******************************************
+ * Get the state of one of a grid's cells *
+ ******************************************/
+int get_cell(struct grid *grid, int row, int col)
+{
+  if(grid->cell_type == CELL_BIT)
+    return (((uint64_t*)grid_row(grid, row))[col / BITS_PER_WORD]
+        >> (col % BITS_PER_WORD)) & 1;
+  else if(grid->cell_type == CELL_UINT32)
+    return ((uint32_t*)grid_row(grid, row))[col];
+  return ((uint8_t*)grid_row(grid, row))[col];
+}
+
+/******************************************
+ * Set the state of one of a grid's cells *
+ ******************************************/
+void set_cell(struct grid *grid, int row, int col, int state)
+{
+  uint64_t *word;
+  uint64_t bit;
+
+  if(grid->cell_type == CELL_BIT)
   {
-    exit(-1);
+    word = &((uint64_t*)grid_row(grid, row))[col / BITS_PER_WORD];
+    bit = (uint64_t)1 << (col % BITS_PER_WORD);
+    if(state == ALIVE)
+      *word |= bit;
+    else
+      *word &= ~bit;
   }
+  else if(grid->cell_type == CELL_UINT32)
+    ((uint32_t*)grid_row(grid, row))[col] = state;
+  else
+    ((uint8_t*)grid_row(grid, row))[col] = state;
 
-  /* Allocate enough space in the current grid and next grid for the
-   *  number of rows and the number of columns, plus the ghost rows
-   *  and columns */
-  exit_if(((current_grid = (int**)malloc((NUM_ROWS + 2) 
-            * (NUM_COLS + 2) * sizeof(int))) == NULL),
-      "malloc(current_grid)", 0);
-  exit_if(((next_grid = (int**)malloc((NUM_ROWS + 2) 
-            * (NUM_COLS + 2) * sizeof(int))) == NULL),
-      "malloc(next_grid)", 0);
-  for(row = 0; row <= NUM_ROWS + 1; row++)
+  return;
+}
+
+/*******************************************************************************
+ * Copy the opposite edges of rows row_begin up to row_end of a grid into
+ *  their ghost columns
+ ******************************************************************************/
+void update_ghost_columns(struct grid *grid, int row_begin, int row_end)
+{
+  int row;
+
+  /* The left ghost column is the same as the farthest-right, non-ghost
+     column, and the right ghost column is the same as the farthest-left,
+     non-ghost column */
+#pragma omp parallel for
+  for(row = row_begin; row < row_end; row++)
   {
-    exit_if(((current_grid[row]
-            = (int*)malloc((NUM_COLS + 2) * sizeof(int))) 
-          == NULL), "malloc(current_grid[some_row])", 0);
-    exit_if(((next_grid[row]
-            = (int*)malloc((NUM_COLS + 2) * sizeof(int)))
-          == NULL), "malloc(next_grid[some_row])", 0);
+    set_cell(grid, row, 0, get_cell(grid, row, grid->num_cols));
+    set_cell(grid, row, grid->num_cols + 1, get_cell(grid, row, 1));
   }
 
-  srandom(time(NULL));
+  return;
+}
+
+/**********************************************************
+ * Copy the opposite edges of a grid into its ghost cells *
+ **********************************************************/
+void update_ghosts(struct grid *grid)
+{
+  /* Set the top row to be the same as the second-to-last row, and the bottom
+     row to be the same as the second-to-top row */
+  memcpy(grid_row(grid, 0), grid_row(grid, grid->num_rows), grid->row_bytes);
+  memcpy(grid_row(grid, grid->num_rows + 1), grid_row(grid, 1),
+      grid->row_bytes);
+  update_ghost_columns(grid, 0, grid->num_rows + 2);
+
+  return;
+}
+
+/*******************************************************************************
+ * A Life-like rule, written B<counts>/S<counts>: a DEAD cell is born if its
+ *  number of ALIVE neighbors is one of the B counts, and an ALIVE cell
+ *  survives if its number is one of the S counts. Conway's Game of Life is
+ *  B3/S23. Byte and word grids look the next state up in a table; bit grids
+ *  use the stepper chosen for the rule and the CPU.
+ ******************************************************************************/
+struct rule;
+
+typedef int (*bit_stepper)(struct grid *current, struct grid *next,
+    int row_begin, int row_end, int word_begin, int word_end,
+    const struct rule *rule);
+
+struct rule
+{
+  int birth;                  /* bit n is set if n neighbors give birth */
+  int survival;               /* bit n is set if n neighbors mean survival */
+  uint8_t next_state[2][9];   /* indexed by state and number of neighbors */
+  bit_stepper step_bit_block;
+};
+
+/*******************************************************************************
+ * Parse a rule such as "B3/S23" (either half may come first, and case does
+ *  not matter) and fill in its lookup table. Return 0 on success, or print an
+ *  error and return -1. Rules with B0 would bring the empty space around
+ *  every pattern to life, which the tiled and HashLife engines rely on never
+ *  happening, so they are refused.
+ ******************************************************************************/
+int parse_rule(char *string, struct rule *rule)
+{
+  char *c;
+  int *counts = NULL, state, num_alive_neighbors, seen_birth = 0,
+      seen_survival = 0;
 
-  /* Initialize the grid (each cell gets a random state) */
-  for(row = 1; row <= NUM_ROWS; row++)
+  rule->birth = rule->survival = 0;
+  for(c = string; *c != '\0'; c++)
   {
-    for(col = 1; col <= NUM_COLS; col++)
+    if((*c == 'B' || *c == 'b') && !seen_birth)
     {
-      current_grid[row][col] = random() % (ALIVE + 1);
+      counts = &rule->birth;
+      seen_birth = 1;
     }
+    else if((*c == 'S' || *c == 's') && !seen_survival)
+    {
+      counts = &rule->survival;
+      seen_survival = 1;
+    }
+    else if(*c >= '0' && *c <= '8' && counts != NULL)
+      *counts |= 1 << (*c - '0');
+    else if(*c != '/' || counts == NULL)
+      break;
   }
 
-  /* Run the simulation for the specified number of time steps */
-  for(step = 0; step <= NUM_STEPS - 1; step++)
+  if(*c != '\0' || !seen_birth || !seen_survival)
   {
-    for(col = 0; col <= NUM_COLS + 1; col++)
-    {
-      /* Set the top row to be the same as the second-to-last row */
-      current_grid[0][col] = current_grid[NUM_ROWS][col];
+    fprintf(stderr, "ERROR: bad rule %s; need a rule like B3/S23\n", string);
+    return -1;
+  }
+  if(rule->birth & 1)
+  {
+    fprintf(stderr, "ERROR: rule %s gives birth with 0 neighbors, which is not supported\n",
+        string);
+    return -1;
+  }
 
-      /* Set the bottom row to be the same as the second-to-top row */
-      current_grid[NUM_ROWS + 1][col] = current_grid[1][col];
+  for(state = DEAD; state <= ALIVE; state++)
+  {
+    for(num_alive_neighbors = 0; num_alive_neighbors <= 8;
+        num_alive_neighbors++)
+    {
+      rule->next_state[state][num_alive_neighbors]
+        = ((((state == ALIVE) ? rule->survival : rule->birth)
+              >> num_alive_neighbors) & 1) ? ALIVE : DEAD;
     }
+  }
 
-    /* Set up the ghost columns */
-    for(row = 0; row <= NUM_ROWS + 1; row++)
-    {
-      /* The left ghost column is the same as the farthest-right, non-ghost
-         column */
-      current_grid[row][0] = current_grid[row][NUM_COLS];
+  return 0;
+}
 
-      /* The right ghost column is the same as the farthest-left, non-ghost
-         column */
-      current_grid[row][NUM_COLS + 1] = current_grid[row][1];
-    }
+/*******************************************************************************
+ * Write a rule in its usual form, such as "B36/S23"
+ ******************************************************************************/
+void format_rule(const struct rule *rule, char *string, size_t size)
+{
+  char *c = string;
+  int count;
 
-    /* Display the current grid */
-    printf("Time Step %d:\n", step);
-    for(row = 0; row <= NUM_ROWS + 1; row++)
-    {
-      if(row == 1)
-      {
-        for(col = 0; col <= NUM_COLS + 1 + 2; col++)
-        {
-          printf("- ");
-        }
-        printf("\n");
-      }
+  *c++ = 'B';
+  for(count = 0; count <= 8; count++)
+    if((rule->birth >> count) & 1)
+      *c++ = '0' + count;
+  *c++ = '/';
+  *c++ = 'S';
+  for(count = 0; count <= 8; count++)
+    if((rule->survival >> count) & 1)
+      *c++ = '0' + count;
+  *c = '\0';
 
-      for(col = 0; col <= NUM_COLS + 1; col++)
-      {
-        if(col == 1)
-        {
-          printf("| ");
-        }
+  exit_if(((size_t)(c - string) >= size), "format_rule", 0);
 
-        printf("%d ", current_grid[row][col]);
+  return;
+}
 
-        if(col == NUM_COLS)
-        {
-          printf("| ");
-        }
-      }
-      printf("\n");
+/* 256-bit and 512-bit vectors of words, for the AVX2 and AVX-512 steppers */
+typedef uint64_t words_x4 __attribute__((vector_size(32)));
+typedef uint64_t words_x8 __attribute__((vector_size(64)));
 
-      if(row == NUM_ROWS)
-      {
-        for(col = 0; col <= NUM_COLS + 1 + 2; col++)
-        {
-          printf("- ");
-        }
-        printf("\n");
-      }
-    }
+/*******************************************************************************
+ * Define a function that determines the next state of a word (or vector of
+ *  words) of a bit grid. Each word holds 64 cells, so the eight neighbors of
+ *  64 cells are counted at once: the rows above, at and below are shifted one
+ *  cell left and right (pulling in a bit of the neighboring words), and the
+ *  eight shifted words are summed with bit-sliced full adders into the four
+ *  bits (ones, twos, fours, eights) of each cell's neighbor count. The count
+ *  is then matched against each count in the rule; when the rule is a
+ *  constant the loop unrolls and folds down to a handful of bit operations.
+ ******************************************************************************/
+#define DEFINE_RULE_WORDS(name, word_t, target) \
+static inline __attribute__((always_inline)) target word_t name( \
+    word_t above_prev, word_t above, word_t above_next, \
+    word_t middle_prev, word_t middle, word_t middle_next, \
+    word_t below_prev, word_t below, word_t below_next, \
+    int birth, int survival) \
+{ \
+  word_t above_left, above_right, middle_left, middle_right, below_left, \
+         below_right, above_ones, above_twos, middle_ones, middle_twos, \
+         below_ones, below_twos, carry, twos_sum, twos_carry, \
+         ones, twos, fours, eights, born, survives, count_matches; \
+  int count; \
+  \
+  /* Line up each cell's left and right neighbors with the cell itself */ \
+  above_left = (above << 1) | (above_prev >> 63); \
+  above_right = (above >> 1) | (above_next << 63); \
+  middle_left = (middle << 1) | (middle_prev >> 63); \
+  middle_right = (middle >> 1) | (middle_next << 63); \
+  below_left = (below << 1) | (below_prev >> 63); \
+  below_right = (below >> 1) | (below_next << 63); \
+  \
+  /* Add up the three neighbors above and the three below with full \
+     adders, and the two beside with a half adder */ \
+  above_ones = above_left ^ above ^ above_right; \
+  above_twos = (above_left & above) | (above_right & (above_left ^ above)); \
+  middle_ones = middle_left ^ middle_right; \
+  middle_twos = middle_left & middle_right; \
+  below_ones = below_left ^ below ^ below_right; \
+  below_twos = (below_left & below) | (below_right & (below_left ^ below)); \
+  \
+  /* Add the three ones bits; the carry goes into the twos */ \
+  ones = above_ones ^ middle_ones ^ below_ones; \
+  carry = (above_ones & middle_ones) | (below_ones \
+      & (above_ones ^ middle_ones)); \
+  \
+  /* Add the four twos bits; the carries go into the fours and eights */ \
+  twos_sum = above_twos ^ middle_twos ^ below_twos; \
+  twos_carry = (above_twos & middle_twos) | (below_twos \
+      & (above_twos ^ middle_twos)); \
+  twos = twos_sum ^ carry; \
+  fours = twos_carry ^ (twos_sum & carry); \
+  eights = twos_carry & twos_sum & carry; \
+  \
+  /* A DEAD cell is born, and an ALIVE cell survives, if its count is one \
+     of the rule's counts */ \
+  born = survives = middle ^ middle; \
+  _Pragma("GCC unroll 9") \
+  for(count = 0; count <= 8; count++) \
+  { \
+    if((((birth | survival) >> count) & 1) == 0) \
+      continue; \
+    count_matches = ((count & 8) ? eights : ~eights) \
+      & ((count & 4) ? fours : ~fours) & ((count & 2) ? twos : ~twos) \
+      & ((count & 1) ? ones : ~ones); \
+    if((birth >> count) & 1) \
+      born |= count_matches; \
+    if((survival >> count) & 1) \
+      survives |= count_matches; \
+  } \
+  \
+  return (~middle & born) | (middle & survives); \
+}
+
+DEFINE_RULE_WORDS(rule_words, uint64_t, )
+DEFINE_RULE_WORDS(rule_words_avx2, words_x4, __attribute__((target("avx2"))))
+DEFINE_RULE_WORDS(rule_words_avx512, words_x8,
+    __attribute__((target("avx512f"))))
+
+/*******************************************************************************
+ * Define a bit_stepper that determines the next state of a block of a bit
+ *  grid: rows row_begin up to (not including) row_end, and words word_begin
+ *  up to word_end of each row. Words away from the ends of a row are done a
+ *  vector at a time; the first and last words of a row, whose ghost and
+ *  padding bits must be masked, and any leftovers are done one at a time.
+ *  The stepper returns 1 if any non-ghost cell of the block changed.
+ ******************************************************************************/
+#define DEFINE_BIT_STEPPER(name, birth, survival, vector_t, rule_vectors, \
+    target) \
+target int name(struct grid *current, struct grid *next, int row_begin, \
+    int row_end, int word_begin, int word_end, const struct rule *rule) \
+{ \
+  int row, word, lane, last_word = current->words_per_row - 1; \
+  int words_per_vector = sizeof(vector_t) / sizeof(uint64_t); \
+  uint64_t *above, *middle, *below, *out; \
+  uint64_t last_word_mask, interior_mask, changed = 0; \
+  uint64_t lanes[sizeof(vector_t) / sizeof(uint64_t)]; \
+  vector_t vectors[9], result, changed_vector; \
+  \
+  (void)rule; \
+  memset(&changed_vector, 0, sizeof(changed_vector)); \
+  \
+  /* Only keep bits up to the right ghost column in the last word */ \
+  last_word_mask = ((current->num_cols + 2) % BITS_PER_WORD == 0) \
+    ? ~(uint64_t)0 \
+    : ((uint64_t)1 << ((current->num_cols + 2) % BITS_PER_WORD)) - 1; \
+  \
+  for(row = row_begin; row < row_end; row++) \
+  { \
+    above = (uint64_t*)grid_row(current, row - 1); \
+    middle = (uint64_t*)grid_row(current, row); \
+    below = (uint64_t*)grid_row(current, row + 1); \
+    out = (uint64_t*)grid_row(next, row); \
+    \
+    for(word = word_begin; word < word_end; ) \
+    { \
+      if(words_per_vector > 1 && word >= 1 \
+          && word + words_per_vector <= word_end \
+          && word + words_per_vector <= last_word) \
+      { \
+        memcpy(&vectors[0], &above[word - 1], sizeof(vector_t)); \
+        memcpy(&vectors[1], &above[word], sizeof(vector_t)); \
+        memcpy(&vectors[2], &above[word + 1], sizeof(vector_t)); \
+        memcpy(&vectors[3], &middle[word - 1], sizeof(vector_t)); \
+        memcpy(&vectors[4], &middle[word], sizeof(vector_t)); \
+        memcpy(&vectors[5], &middle[word + 1], sizeof(vector_t)); \
+        memcpy(&vectors[6], &below[word - 1], sizeof(vector_t)); \
+        memcpy(&vectors[7], &below[word], sizeof(vector_t)); \
+        memcpy(&vectors[8], &below[word + 1], sizeof(vector_t)); \
+        result = rule_vectors(vectors[0], vectors[1], vectors[2], \
+            vectors[3], vectors[4], vectors[5], vectors[6], vectors[7], \
+            vectors[8], birth, survival); \
+        memcpy(&out[word], &result, sizeof(vector_t)); \
+        changed_vector |= result ^ vectors[4]; \
+        word += words_per_vector; \
+      } \
+      else \
+      { \
+        out[word] = rule_words(above[word - 1], above[word], \
+            above[word + 1], middle[word - 1], middle[word], \
+            middle[word + 1], below[word - 1], below[word], \
+            below[word + 1], birth, survival); \
+        \
+        /* Note any change to a non-ghost cell */ \
+        interior_mask = ~(uint64_t)0; \
+        if(word == 0) \
+          interior_mask &= ~(uint64_t)1; \
+        if(word == last_word) \
+        { \
+          out[word] &= last_word_mask; \
+          interior_mask &= last_word_mask >> 1; \
+        } \
+        changed |= (out[word] ^ middle[word]) & interior_mask; \
+        word++; \
+      } \
+    } \
+  } \
+  \
+  memcpy(lanes, &changed_vector, sizeof(vector_t)); \
+  for(lane = 0; lane < words_per_vector; lane++) \
+    changed |= lanes[lane]; \
+  \
+  return changed != 0; \
+}
+
+/*******************************************************************************
+ * Define the plain, AVX2 and AVX-512 steppers for a rule
+ ******************************************************************************/
+#define DEFINE_BIT_STEPPERS(rule_name, birth, survival) \
+DEFINE_BIT_STEPPER(step_bit_block_##rule_name, birth, survival, uint64_t, \
+    rule_words, ) \
+DEFINE_BIT_STEPPER(step_bit_block_##rule_name##_avx2, birth, survival, \
+    words_x4, rule_words_avx2, __attribute__((target("avx2")))) \
+DEFINE_BIT_STEPPER(step_bit_block_##rule_name##_avx512, birth, survival, \
+    words_x8, rule_words_avx512, __attribute__((target("avx512f"))))
+
+/* Steppers specialized at compile time for common rules... */
+DEFINE_BIT_STEPPERS(life, 0x008, 0x00C)            /* B3/S23 */
+DEFINE_BIT_STEPPERS(highlife, 0x048, 0x00C)        /* B36/S23 */
+DEFINE_BIT_STEPPERS(day_and_night, 0x1C8, 0x1D8)   /* B3678/S34678 */
+DEFINE_BIT_STEPPERS(seeds, 0x004, 0x000)           /* B2/S */
+
+/* ...and for any other rule, read from the rule at run time */
+DEFINE_BIT_STEPPERS(any, rule->birth, rule->survival)
+
+/**************************************************************************
+ * Instruction sets the bit steppers can use, chosen with -k (or the best *
+ *  one the CPU supports)                                                 *
+ **************************************************************************/
+#define ISA_AUTO -1
+#define ISA_PLAIN 0
+#define ISA_AVX2 1
+#define ISA_AVX512 2
+
+struct specialized_rule
+{
+  int birth;
+  int survival;
+  bit_stepper steppers[3];   /* indexed by instruction set */
+};
+
+const struct specialized_rule SPECIALIZED_RULES[] = {
+  { 0x008, 0x00C, { step_bit_block_life, step_bit_block_life_avx2,
+                    step_bit_block_life_avx512 } },
+  { 0x048, 0x00C, { step_bit_block_highlife, step_bit_block_highlife_avx2,
+                    step_bit_block_highlife_avx512 } },
+  { 0x1C8, 0x1D8, { step_bit_block_day_and_night,
+                    step_bit_block_day_and_night_avx2,
+                    step_bit_block_day_and_night_avx512 } },
+  { 0x004, 0x000, { step_bit_block_seeds, step_bit_block_seeds_avx2,
+                    step_bit_block_seeds_avx512 } }
+};
+
+/*******************************************************************************
+ * Choose a rule's bit stepper: the one specialized for the rule if there is
+ *  one, for the given instruction set, or for the best one this CPU supports.
+ *  Return 0 on success, or print an error and return -1 if the CPU does not
+ *  support the given instruction set.
+ ******************************************************************************/
+int choose_bit_stepper(struct rule *rule, int isa)
+{
+  bit_stepper any_steppers[3] = { step_bit_block_any, step_bit_block_any_avx2,
+    step_bit_block_any_avx512 };
+  const bit_stepper *steppers = any_steppers;
+  int i;
+
+  __builtin_cpu_init();
+  if(isa == ISA_AUTO)
+  {
+    if(__builtin_cpu_supports("avx512f"))
+      isa = ISA_AVX512;
+    else if(__builtin_cpu_supports("avx2"))
+      isa = ISA_AVX2;
+    else
+      isa = ISA_PLAIN;
+  }
+  else if((isa == ISA_AVX512 && !__builtin_cpu_supports("avx512f"))
+      || (isa == ISA_AVX2 && !__builtin_cpu_supports("avx2")))
+  {
+    fprintf(stderr, "ERROR: this CPU does not support the chosen kernel\n");
+    return -1;
+  }
+
+  for(i = 0; i < (int)(sizeof(SPECIALIZED_RULES)
+        / sizeof(SPECIALIZED_RULES[0])); i++)
+  {
+    if(SPECIALIZED_RULES[i].birth == rule->birth
+        && SPECIALIZED_RULES[i].survival == rule->survival)
+      steppers = SPECIALIZED_RULES[i].steppers;
+  }
+  rule->step_bit_block = steppers[isa];
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Load and store a cell of a byte or word row. The cell type is a constant in
+ *  every caller, so the compiler specializes each stepper for its type.
+ ******************************************************************************/
+static inline int load_cell(void *row, int col, int cell_type)
+{
+  if(cell_type == CELL_UINT32)
+    return ((uint32_t*)row)[col];
+  return ((uint8_t*)row)[col];
+}
+
+static inline void store_cell(void *row, int col, int cell_type, int state)
+{
+  if(cell_type == CELL_UINT32)
+    ((uint32_t*)row)[col] = state;
+  else
+    ((uint8_t*)row)[col] = state;
+}
+
+/*******************************************************************************
+ * Determine the next state of a block of a byte or word grid: rows row_begin
+ *  up to (not including) row_end, and columns col_begin up to col_end. Return
+ *  1 if any cell of the block changed, 0 if none did.
+ ******************************************************************************/
+static inline int step_scalar_block(struct grid *current, struct grid *next,
+    int cell_type, int row_begin, int row_end, int col_begin, int col_end,
+    const struct rule *rule)
+{
+  int row, col, neighbor_row, neighbor_column, num_alive_neighbors, state;
+  int changed = 0;
+  void *current_row, *next_row;
+
+  /* For each row, do the following: */
+  for(row = row_begin; row < row_end; row++)
+  {
+    current_row = grid_row(current, row);
+    next_row = grid_row(next, row);
 
-    /* Determine the next grid -- for each row, do the following: */
-    for(row = 1; row <= NUM_ROWS; row++)
+    /* For each column, do the following: */
+    for(col = col_begin; col < col_end; col++)
     {
-      /* For each column, do the following: */
-      for(col = 1; col <= NUM_COLS; col++)
-      {
-        /* Initialize the count of ALIVE neighbors to 0 */
-        num_alive_neighbors = 0;
+      /* Initialize the count of ALIVE neighbors to 0 */
+      num_alive_neighbors = 0;
 
-        /* For each row of the cell's neighbors, do the following: */
-        for(neighbor_row = row - 1; neighbor_row <= row + 1; neighbor_row++)
+      /* For each row of the cell's neighbors, do the following: */
+      for(neighbor_row = row - 1; neighbor_row <= row + 1; neighbor_row++)
+      {
+        /* For each column of the cell's neighbors, do the following: */
+        for(neighbor_column = col - 1; neighbor_column <= col + 1;
+            neighbor_column++)
         {
-          /* For each column of the cell's neighbors, do the following: */
-          for(neighbor_column = col - 1; neighbor_column <= col + 1;
-              neighbor_column++)
+          /* If the neighbor is not the cell itself, and the neighbor is
+             ALIVE, do the following: */
+          if((neighbor_row != row || neighbor_column != col) &&
+             (load_cell(grid_row(current, neighbor_row), neighbor_column,
+                        cell_type) == ALIVE))
           {
-            /* If the neighbor is not the cell itself, and the neighbor is
-               ALIVE, do the following: */
-            if((neighbor_row != row || neighbor_column != col) &&
-               (current_grid[neighbor_row][neighbor_column] == ALIVE))
-            {
-              /* Add 1 to the count of the number of ALIVE neighbors */
-              num_alive_neighbors++;
-            }
+            /* Add 1 to the count of the number of ALIVE neighbors */
+            num_alive_neighbors++;
           }
         }
+      }
 
-        /* Apply Rule 1 of Conway's Game of Life */
-        if(num_alive_neighbors < 2)
-        {
-          next_grid[row][col] = DEAD;
-        }
+      /* Apply the rule: look up the next state from the cell's state and
+         its number of ALIVE neighbors */
+      state = rule->next_state[load_cell(current_row, col, cell_type)]
+        [num_alive_neighbors];
 
-        /* Apply Rule 2 of Conway's Game of Life */
-        else if(current_grid[row][col] == ALIVE &&
-           (num_alive_neighbors == 2 || num_alive_neighbors == 3))
-        {
-          next_grid[row][col] = ALIVE;
-        }
+      changed |= (state != load_cell(current_row, col, cell_type));
+      store_cell(next_row, col, cell_type, state);
+    }
+  }
 
-        /* Apply Rule 3 of Conway's Game of Life */
-        else if(num_alive_neighbors > 3)
-        {
-          next_grid[row][col] = DEAD;
-        }
+  return changed;
+}
 
-        /* Apply Rule 4 of Conway's Game of Life */
-        else if(current_grid[row][col] == DEAD && num_alive_neighbors == 3)
-        {
-          next_grid[row][col] = ALIVE;
-        }
+/****************************************************
+ * Steppers specialized for byte and for word cells *
+ ****************************************************/
+int step_uint8_block(struct grid *current, struct grid *next, int row_begin,
+    int row_end, int col_begin, int col_end, const struct rule *rule)
+{
+  return step_scalar_block(current, next, CELL_UINT8, row_begin, row_end,
+      col_begin, col_end, rule);
+}
 
-        /* No rule applies; keep the same state */
-        else
-        {
-          next_grid[row][col] = current_grid[row][col];
-        }
-      }
-    }
+int step_uint32_block(struct grid *current, struct grid *next, int row_begin,
+    int row_end, int col_begin, int col_end, const struct rule *rule)
+{
+  return step_scalar_block(current, next, CELL_UINT32, row_begin, row_end,
+      col_begin, col_end, rule);
+}
 
-    /* Copy the next grid into the current grid */
-    for(row = 1; row <= NUM_ROWS; row++)
+/*******************************************************************************
+ * Determine the next state of a block of a grid under a rule with the stepper
+ *  for its cell type. Columns are counted in the grid's units: cells 1 to num_cols for
+ *  byte and word grids, words 0 to words_per_row - 1 for bit grids.
+ ******************************************************************************/
+int step_block(struct grid *current, struct grid *next, int row_begin,
+    int row_end, int unit_begin, int unit_end, const struct rule *rule)
+{
+  if(current->cell_type == CELL_BIT)
+    return rule->step_bit_block(current, next, row_begin, row_end, unit_begin,
+        unit_end, rule);
+  else if(current->cell_type == CELL_UINT32)
+    return step_uint32_block(current, next, row_begin, row_end, unit_begin,
+        unit_end, rule);
+  return step_uint8_block(current, next, row_begin, row_end, unit_begin,
+      unit_end, rule);
+}
+
+/****************************************************************
+ * Get the first and last-plus-one column unit of a grid's rows *
+ ****************************************************************/
+void get_grid_units(struct grid *grid, int *unit_begin, int *unit_end)
+{
+  if(grid->cell_type == CELL_BIT)
+  {
+    *unit_begin = 0;
+    *unit_end = grid->words_per_row;
+  }
+  else
+  {
+    *unit_begin = 1;
+    *unit_end = grid->num_cols + 1;
+  }
+
+  return;
+}
+
+/******************************************************************
+ * Determine the next grid from the current one, a row per thread *
+ ******************************************************************/
+void step_grid(struct grid *current, struct grid *next,
+    const struct rule *rule)
+{
+  int row, unit_begin, unit_end;
+
+  get_grid_units(current, &unit_begin, &unit_end);
+
+#pragma omp parallel for
+  for(row = 1; row <= current->num_rows; row++)
+  {
+    step_block(current, next, row, row + 1, unit_begin, unit_end, rule);
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * Active-region tracking. The non-ghost area of a grid is divided into tiles
+ *  (in bit grids, tile widths are whole words). A tile only needs to be
+ *  stepped if it or one of its eight neighbors changed in the previous step;
+ *  neighbors wrap around the edges like the ghost rows and columns do. A
+ *  skipped tile is left as it is in the next grid, which holds the state from
+ *  two steps back -- the same state, since nothing near the tile changed.
+ ******************************************************************************/
+struct tiles
+{
+  int rows_per_tile;
+  int units_per_tile;
+  int num_tile_rows;
+  int num_tile_cols;
+  int unit_begin;
+  int unit_end;
+  uint8_t *changed;   /* 1 if a cell of the tile changed in the last step */
+  uint8_t *active;    /* 1 if the tile must be stepped this step */
+  int *active_list;
+  int num_active;
+};
+
+/*******************************************************************************
+ * Divide a grid into tiles of about tile_size x tile_size cells, all of which
+ *  start out changed so the first step computes every tile
+ ******************************************************************************/
+void alloc_tiles(struct tiles *tiles, struct grid *grid, int tile_size)
+{
+  int num_tiles;
+
+  get_grid_units(grid, &tiles->unit_begin, &tiles->unit_end);
+  tiles->rows_per_tile = tile_size;
+  tiles->units_per_tile = (grid->cell_type == CELL_BIT)
+    ? (tile_size + BITS_PER_WORD - 1) / BITS_PER_WORD : tile_size;
+  tiles->num_tile_rows = (grid->num_rows + tiles->rows_per_tile - 1)
+    / tiles->rows_per_tile;
+  tiles->num_tile_cols = (tiles->unit_end - tiles->unit_begin
+      + tiles->units_per_tile - 1) / tiles->units_per_tile;
+  num_tiles = tiles->num_tile_rows * tiles->num_tile_cols;
+
+  exit_if(((tiles->changed = (uint8_t*)malloc(num_tiles)) == NULL),
+      "malloc(tiles->changed)", 0);
+  exit_if(((tiles->active = (uint8_t*)malloc(num_tiles)) == NULL),
+      "malloc(tiles->active)", 0);
+  exit_if(((tiles->active_list = (int*)malloc(num_tiles * sizeof(int)))
+        == NULL), "malloc(tiles->active_list)", 0);
+  memset(tiles->changed, 1, num_tiles);
+  tiles->num_active = 0;
+
+  return;
+}
+
+/********************
+ * Deallocate tiles *
+ ********************/
+void free_tiles(struct tiles *tiles)
+{
+  free(tiles->active_list);
+  free(tiles->active);
+  free(tiles->changed);
+
+  return;
+}
+
+/*******************************************************************************
+ * Mark the tiles that changed in the last step and their neighbors active,
+ *  and list the active tiles
+ ******************************************************************************/
+void find_active_tiles(struct tiles *tiles)
+{
+  int tile_row, tile_col, neighbor_row, neighbor_col, tile;
+
+  memset(tiles->active, 0, tiles->num_tile_rows * tiles->num_tile_cols);
+  for(tile_row = 0; tile_row < tiles->num_tile_rows; tile_row++)
+  {
+    for(tile_col = 0; tile_col < tiles->num_tile_cols; tile_col++)
     {
-      for(col = 1; col <= NUM_COLS; col++)
+      if(!tiles->changed[tile_row * tiles->num_tile_cols + tile_col])
+        continue;
+
+      for(neighbor_row = tile_row - 1; neighbor_row <= tile_row + 1;
+          neighbor_row++)
       {
-        current_grid[row][col] = next_grid[row][col];
+        for(neighbor_col = tile_col - 1; neighbor_col <= tile_col + 1;
+            neighbor_col++)
+        {
+          tiles->active[((neighbor_row + tiles->num_tile_rows)
+              % tiles->num_tile_rows) * tiles->num_tile_cols
+            + (neighbor_col + tiles->num_tile_cols) % tiles->num_tile_cols] = 1;
+        }
       }
     }
   }
 
-  /* Deallocate data structures */
-  for(row = NUM_ROWS + 1; row >= 0; row--)
+  tiles->num_active = 0;
+  for(tile = 0; tile < tiles->num_tile_rows * tiles->num_tile_cols; tile++)
+  {
+    if(tiles->active[tile])
+      tiles->active_list[tiles->num_active++] = tile;
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * Determine the next grid from the current one, stepping only the active
+ *  tiles (a tile per thread at a time) and noting which of them changed
+ ******************************************************************************/
+void step_active_tiles(struct grid *current, struct grid *next,
+    struct tiles *tiles, const struct rule *rule)
+{
+  int i, tile, row_begin, row_end, unit_begin, unit_end;
+
+#pragma omp parallel for schedule(dynamic) private(tile, row_begin, row_end, \
+    unit_begin, unit_end)
+  for(i = 0; i < tiles->num_active; i++)
   {
-    free(next_grid[row]);
-    free(current_grid[row]);
+    tile = tiles->active_list[i];
+    row_begin = 1 + (tile / tiles->num_tile_cols) * tiles->rows_per_tile;
+    row_end = row_begin + tiles->rows_per_tile;
+    if(row_end > current->num_rows + 1)
+      row_end = current->num_rows + 1;
+    unit_begin = tiles->unit_begin
+      + (tile % tiles->num_tile_cols) * tiles->units_per_tile;
+    unit_end = unit_begin + tiles->units_per_tile;
+    if(unit_end > tiles->unit_end)
+      unit_end = tiles->unit_end;
+
+    tiles->changed[tile] = step_block(current, next, row_begin, row_end,
+        unit_begin, unit_end, rule);
   }
-  free(next_grid);
-  free(current_grid);
+
+  /* Tiles that were not stepped did not change */
+  for(tile = 0; tile < tiles->num_tile_rows * tiles->num_tile_cols; tile++)
+  {
+    if(!tiles->active[tile])
+      tiles->changed[tile] = 0;
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * Temporal blocking. Rather than streaming the whole grid through memory once
+ *  per step, the grid is cut into blocks, and each block is copied with a
+ *  halo of DEPTH extra cells on every side (wrapping around the torus) into a
+ *  small, cache-resident pair of local grids, advanced up to DEPTH steps there,
+ *  and copied back. Each step the valid part of the local grid shrinks by one
+ *  cell on every side, so after DEPTH steps exactly the block is still valid;
+ *  the halo cells are computed redundantly by neighboring blocks. In bit
+ *  grids blocks are whole words wide and the halo is one word (64 cells), so
+ *  DEPTH can be at most 64.
+ ******************************************************************************/
+
+/********************************************************************
+ * Map a row or column index onto 1 to n, wrapping around the torus *
+ ********************************************************************/
+int wrap_index(int index, int n)
+{
+  return ((index - 1) % n + n) % n + 1;
+}
+
+/*******************************************************************************
+ * Allocate the two local grids a thread needs for blocks of block_size cells
+ *  with halos for depth steps
+ ******************************************************************************/
+void alloc_local_grids(struct grid local[2], struct grid *grid, int block_size,
+    int depth)
+{
+  int i, num_cols;
+
+  if(grid->cell_type == CELL_BIT)
+    num_cols = BITS_PER_WORD * ((block_size + BITS_PER_WORD - 1)
+        / BITS_PER_WORD + 2) - 2;
+  else
+    num_cols = block_size + 2 * depth;
+
+  for(i = 0; i < 2; i++)
+    alloc_grid(&local[i], block_size + 2 * depth, num_cols, grid->cell_type);
+
+  return;
+}
+
+/*******************************************************************************
+ * Advance one block of the current grid -- rows row_begin up to row_end and
+ *  units unit_begin up to unit_end -- by num_steps steps into the next grid,
+ *  using a thread's local grids
+ ******************************************************************************/
+void step_temporal_block(struct grid *current, struct grid *next,
+    struct grid local[2], int depth, int num_steps, int row_begin,
+    int row_end, int unit_begin, int unit_end, const struct rule *rule)
+{
+  struct grid *local_current = &local[0], *local_next = &local[1], *temp;
+  int num_rows = row_end - row_begin, num_units = unit_end - unit_begin;
+  int local_row, local_col, local_word, global_row, global_col, global_word,
+      bit, step, row;
+  uint64_t word, last_word_mask;
+  int is_bit = (current->cell_type == CELL_BIT);
+
+  /* Size the local grids for this block; they were allocated for the
+   *  largest block, so only the number of rows and columns change */
+  for(row = 0; row < 2; row++)
+  {
+    local[row].num_rows = num_rows + 2 * depth;
+    if(is_bit)
+    {
+      local[row].words_per_row = num_units + 2;
+      local[row].num_cols = BITS_PER_WORD * (num_units + 2) - 2;
+    }
+    else
+      local[row].num_cols = num_units + 2 * depth;
+  }
+
+  /* Copy the block and its halo, including the local ghost rows and columns
+   *  (local row 0 is global row row_begin - depth - 1) */
+  for(local_row = 0; local_row <= num_rows + 2 * depth + 1; local_row++)
+  {
+    global_row = wrap_index(row_begin - depth - 1 + local_row,
+        current->num_rows);
+
+    if(is_bit)
+    {
+      /* Local word 0 is global word unit_begin - 1; words that lie within
+         columns 0 to num_cols + 1 (whose ghost bits wrap already) are copied
+         whole, and the rest bit by bit */
+      for(local_word = 0; local_word < num_units + 2; local_word++)
+      {
+        global_word = unit_begin - 1 + local_word;
+        if(global_word >= 0 && BITS_PER_WORD * global_word + BITS_PER_WORD - 1
+            <= current->num_cols + 1)
+          word = ((uint64_t*)grid_row(current, global_row))[global_word];
+        else
+        {
+          word = 0;
+          for(bit = 0; bit < BITS_PER_WORD; bit++)
+          {
+            global_col = wrap_index(BITS_PER_WORD * global_word + bit,
+                current->num_cols);
+            word |= (uint64_t)get_cell(current, global_row, global_col)
+              << bit;
+          }
+        }
+        ((uint64_t*)grid_row(local_current, local_row))[local_word] = word;
+      }
+    }
+    else
+    {
+      /* Local column 0 is global column unit_begin - depth - 1; columns 0 to
+         num_cols + 1 can be copied straight across since the ghost columns
+         wrap already */
+      global_col = unit_begin - depth - 1;
+      if(global_col >= 0
+          && global_col + num_units + 2 * depth + 1 <= current->num_cols + 1)
+        memcpy(grid_row(local_current, local_row),
+            (uint8_t*)grid_row(current, global_row) + global_col
+            * (current->cell_type == CELL_UINT32 ? sizeof(uint32_t) : 1),
+            (num_units + 2 * depth + 2)
+            * (current->cell_type == CELL_UINT32 ? sizeof(uint32_t) : 1));
+      else
+      {
+        for(local_col = 0; local_col <= num_units + 2 * depth + 1;
+            local_col++)
+        {
+          set_cell(local_current, local_row, local_col,
+              get_cell(current, global_row,
+                wrap_index(global_col + local_col, current->num_cols)));
+        }
+      }
+    }
+  }
+
+  /* Advance the local grid, computing one less cell on each side every
+   *  step (bit grids compute whole rows; their halo word absorbs the error
+   *  that creeps in from the zero words beside it) */
+  for(step = 1; step <= num_steps; step++)
+  {
+    if(is_bit)
+      step_block(local_current, local_next, step,
+          num_rows + 2 * depth + 2 - step, 0, num_units + 2, rule);
+    else
+      step_block(local_current, local_next, step,
+          num_rows + 2 * depth + 2 - step, step,
+          num_units + 2 * depth + 2 - step, rule);
+    temp = local_current;
+    local_current = local_next;
+    local_next = temp;
+  }
+
+  /* Copy the block back out of the local grid */
+  last_word_mask = ((current->num_cols + 2) % BITS_PER_WORD == 0)
+    ? ~(uint64_t)0
+    : ((uint64_t)1 << ((current->num_cols + 2) % BITS_PER_WORD)) - 1;
+  for(row = row_begin; row < row_end; row++)
+  {
+    local_row = row - row_begin + depth + 1;
+    if(is_bit)
+    {
+      memcpy((uint64_t*)grid_row(next, row) + unit_begin,
+          (uint64_t*)grid_row(local_current, local_row) + 1,
+          num_units * sizeof(uint64_t));
+      if(unit_end == current->words_per_row)
+        ((uint64_t*)grid_row(next, row))[unit_end - 1] &= last_word_mask;
+    }
+    else
+      for(local_col = depth + 1; local_col <= depth + num_units; local_col++)
+        set_cell(next, row, unit_begin + local_col - depth - 1,
+            get_cell(local_current, local_row, local_col));
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * Advance the current grid by num_steps (at most depth) steps into the next
+ *  grid one block at a time, a block per thread at a time. local holds two
+ *  local grids per thread.
+ ******************************************************************************/
+void step_temporal_blocks(struct grid *current, struct grid *next,
+    struct grid *local, int block_size, int depth, int num_steps,
+    const struct rule *rule)
+{
+  int unit_begin, unit_end, units_per_block, num_block_rows, num_block_cols,
+      block, row_begin, row_end, block_unit_begin, block_unit_end;
+
+  get_grid_units(current, &unit_begin, &unit_end);
+  units_per_block = (current->cell_type == CELL_BIT)
+    ? (block_size + BITS_PER_WORD - 1) / BITS_PER_WORD : block_size;
+  num_block_rows = (current->num_rows + block_size - 1) / block_size;
+  num_block_cols = (unit_end - unit_begin + units_per_block - 1)
+    / units_per_block;
+
+#pragma omp parallel for schedule(dynamic) private(row_begin, row_end, \
+    block_unit_begin, block_unit_end)
+  for(block = 0; block < num_block_rows * num_block_cols; block++)
+  {
+    row_begin = 1 + (block / num_block_cols) * block_size;
+    row_end = row_begin + block_size;
+    if(row_end > current->num_rows + 1)
+      row_end = current->num_rows + 1;
+    block_unit_begin = unit_begin + (block % num_block_cols) * units_per_block;
+    block_unit_end = block_unit_begin + units_per_block;
+    if(block_unit_end > unit_end)
+      block_unit_end = unit_end;
+
+    step_temporal_block(current, next, &local[2 * omp_get_thread_num()],
+        depth, num_steps, row_begin, row_end, block_unit_begin,
+        block_unit_end, rule);
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * Output. Every OUTPUT_INTERVAL steps the grid is written to the output file
+ *  in one of these formats:
+ *   ascii  -- every cell, including the ghost rows and columns, as 0 or 1
+ *   rle    -- the non-ghost cells as a standard run-length encoded pattern,
+ *             preceded by a "#C Time Step N" comment
+ *   binary -- a frame of the non-ghost cells: the four bytes "LIFE", then
+ *             the number of rows and columns as 32-bit and the step as 64-bit
+ *             native-endian integers, then each row packed 8 cells per byte,
+ *             first cell in the lowest bit
+ *   none   -- nothing
+ *  Each frame is built in memory and handed to a writer thread, which writes
+ *  it while the next steps are computed; there are two frame buffers, so the
+ *  simulation only waits if the writer is still busy with the frame before.
+ ******************************************************************************/
+#define FORMAT_NONE 0
+#define FORMAT_ASCII 1
+#define FORMAT_RLE 2
+#define FORMAT_BINARY 3
+
+/* RLE lines are at most this long */
+#define RLE_LINE_LENGTH 70
+
+struct output
+{
+  int format;
+  int interval;
+  FILE *file;
+  char rule[32];
+  char *buffers[2];
+  size_t sizes[2];
+  size_t capacities[2];
+  int filling;        /* the buffer the next frame is built in */
+  int pending;        /* 1 while the writer thread owns the other buffer */
+  int done;           /* 1 once there are no more frames */
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+/*******************************************************************************
+ * Write each frame handed over by the simulation until there are no more
+ ******************************************************************************/
+void *output_writer(void *arg)
+{
+  struct output *output = (struct output*)arg;
+  int writing;
+
+  pthread_mutex_lock(&output->lock);
+  while(1)
+  {
+    while(!output->pending && !output->done)
+      pthread_cond_wait(&output->cond, &output->lock);
+    if(!output->pending)
+      break;
+
+    writing = 1 - output->filling;
+    pthread_mutex_unlock(&output->lock);
+    exit_if((fwrite(output->buffers[writing], 1, output->sizes[writing],
+            output->file) != output->sizes[writing]), "fwrite(output)", 0);
+    pthread_mutex_lock(&output->lock);
+
+    output->pending = 0;
+    pthread_cond_signal(&output->cond);
+  }
+  pthread_mutex_unlock(&output->lock);
+
+  return NULL;
+}
+
+/*******************************************************************************
+ * Open an output (path "-" is standard output) and start its writer thread
+ ******************************************************************************/
+void open_output(struct output *output, int format, int interval,
+    char *path, const struct rule *rule)
+{
+  memset(output, 0, sizeof(*output));
+  output->format = format;
+  output->interval = interval;
+  format_rule(rule, output->rule, sizeof(output->rule));
+
+  if(strcmp(path, "-") == 0)
+    output->file = stdout;
+  else
+    exit_if(((output->file = fopen(path, "wb")) == NULL), "fopen(output)", 0);
+
+  pthread_mutex_init(&output->lock, NULL);
+  pthread_cond_init(&output->cond, NULL);
+  exit_if((pthread_create(&output->writer, NULL, output_writer, output) != 0),
+      "pthread_create(writer)", 0);
+
+  return;
+}
+
+/*******************************************************************************
+ * Wait for the writer thread to write the last frame, then close the output
+ ******************************************************************************/
+void close_output(struct output *output)
+{
+  pthread_mutex_lock(&output->lock);
+  output->done = 1;
+  pthread_cond_signal(&output->cond);
+  pthread_mutex_unlock(&output->lock);
+  pthread_join(output->writer, NULL);
+
+  fflush(output->file);
+  if(output->file != stdout)
+    fclose(output->file);
+  free(output->buffers[0]);
+  free(output->buffers[1]);
+  pthread_cond_destroy(&output->cond);
+  pthread_mutex_destroy(&output->lock);
+
+  return;
+}
+
+/***************************************************************
+ * Append bytes to the frame being built, growing it if needed *
+ ***************************************************************/
+void output_append(struct output *output, const void *data, size_t size)
+{
+  int i = output->filling;
+
+  if(output->sizes[i] + size > output->capacities[i])
+  {
+    output->capacities[i] = 2 * (output->sizes[i] + size);
+    exit_if(((output->buffers[i] = (char*)realloc(output->buffers[i],
+              output->capacities[i])) == NULL), "realloc(output)", 0);
+  }
+  memcpy(output->buffers[i] + output->sizes[i], data, size);
+  output->sizes[i] += size;
+
+  return;
+}
+
+/**************************************************
+ * Append formatted text to the frame being built *
+ **************************************************/
+void output_printf(struct output *output, const char *format, ...)
+{
+  char text[256];
+  va_list args;
+  int length;
+
+  va_start(args, format);
+  length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  output_append(output, text, length);
+
+  return;
+}
+
+/*******************************************************************************
+ * Append a grid, including its ghost rows and columns, as text
+ ******************************************************************************/
+void append_ascii_frame(struct output *output, struct grid *grid, int step)
+{
+  int NUM_ROWS = grid->num_rows, NUM_COLS = grid->num_cols;
+  int row, col;
+  size_t border_length;
+  char *border, *line, *c;
+
+  exit_if(((border = (char*)malloc(2 * (NUM_COLS + 4) + 2)) == NULL),
+      "malloc(border)", 0);
+  exit_if(((line = (char*)malloc(2 * (NUM_COLS + 4) + 2)) == NULL),
+      "malloc(line)", 0);
+
+  /* The border above and below the non-ghost rows */
+  for(col = 0, c = border; col <= NUM_COLS + 1 + 2; col++)
+  {
+    *c++ = '-';
+    *c++ = ' ';
+  }
+  *c++ = '\n';
+  border_length = c - border;
+
+  output_printf(output, "Time Step %d:\n", step);
+  for(row = 0; row <= NUM_ROWS + 1; row++)
+  {
+    if(row == 1)
+      output_append(output, border, border_length);
+
+    for(col = 0, c = line; col <= NUM_COLS + 1; col++)
+    {
+      if(col == 1)
+      {
+        *c++ = '|';
+        *c++ = ' ';
+      }
+
+      *c++ = '0' + get_cell(grid, row, col);
+      *c++ = ' ';
+
+      if(col == NUM_COLS)
+      {
+        *c++ = '|';
+        *c++ = ' ';
+      }
+    }
+    *c++ = '\n';
+    output_append(output, line, c - line);
+
+    if(row == NUM_ROWS)
+      output_append(output, border, border_length);
+  }
+
+  free(line);
+  free(border);
+
+  return;
+}
+
+/*******************************************************************************
+ * Append a run of count cells (tag 'b' DEAD, 'o' ALIVE) or of ends of rows
+ *  (tag '$') to an RLE pattern, starting a new line if this one is full
+ ******************************************************************************/
+void append_rle_run(struct output *output, int count, char tag,
+    int *line_length)
+{
+  char run[16];
+  int length;
+
+  if(count == 1)
+    length = snprintf(run, sizeof(run), "%c", tag);
+  else
+    length = snprintf(run, sizeof(run), "%d%c", count, tag);
+
+  if(*line_length + length > RLE_LINE_LENGTH)
+  {
+    output_append(output, "\n", 1);
+    *line_length = 0;
+  }
+  output_append(output, run, length);
+  *line_length += length;
+
+  return;
+}
+
+/*******************************************************************************
+ * Append the non-ghost cells of a grid as an RLE pattern. DEAD cells at the
+ *  end of a row and empty rows at the end of the pattern are left out.
+ ******************************************************************************/
+void append_rle_frame(struct output *output, struct grid *grid, int step)
+{
+  int row, col, state, run_length, num_row_ends = 0, line_length = 0;
+
+  output_printf(output, "#C Time Step %d\nx = %d, y = %d, rule = %s\n", step,
+      grid->num_cols, grid->num_rows, output->rule);
+  for(row = 1; row <= grid->num_rows; row++)
+  {
+    num_row_ends++;
+    for(col = 1; col <= grid->num_cols; col += run_length)
+    {
+      state = get_cell(grid, row, col);
+      for(run_length = 1; col + run_length <= grid->num_cols
+          && get_cell(grid, row, col + run_length) == state; run_length++)
+        ;
+
+      /* A run of DEAD cells that ends the row is left out */
+      if(state == DEAD && col + run_length > grid->num_cols)
+        break;
+
+      if(num_row_ends > 1)
+        append_rle_run(output, num_row_ends - 1, '$', &line_length);
+      num_row_ends = 1;
+      append_rle_run(output, run_length, (state == ALIVE) ? 'o' : 'b',
+          &line_length);
+    }
+  }
+  output_append(output, "!\n", 2);
+
+  return;
+}
+
+/*******************************************************************************
+ * Append the non-ghost cells of a grid as a binary frame
+ ******************************************************************************/
+void append_binary_frame(struct output *output, struct grid *grid, int step)
+{
+  uint32_t dimensions[2] = { grid->num_rows, grid->num_cols };
+  uint64_t step_number = step;
+  uint8_t *bytes;
+  size_t bytes_per_row = (grid->num_cols + 7) / 8;
+  int row, col;
+
+  exit_if(((bytes = (uint8_t*)malloc(bytes_per_row)) == NULL),
+      "malloc(bytes)", 0);
+
+  output_append(output, "LIFE", 4);
+  output_append(output, dimensions, sizeof(dimensions));
+  output_append(output, &step_number, sizeof(step_number));
+  for(row = 1; row <= grid->num_rows; row++)
+  {
+    memset(bytes, 0, bytes_per_row);
+    for(col = 1; col <= grid->num_cols; col++)
+      bytes[(col - 1) / 8] |= get_cell(grid, row, col) << ((col - 1) % 8);
+    output_append(output, bytes, bytes_per_row);
+  }
+
+  free(bytes);
+
+  return;
+}
+
+/*******************************************************************************
+ * Return 1 if this step is one of the steps to write, 0 if not
+ ******************************************************************************/
+int is_frame_step(struct output *output, int step)
+{
+  return output != NULL && output->format != FORMAT_NONE
+    && step % output->interval == 0;
+}
+
+/*******************************************************************************
+ * Write a grid to the output in its format, if this step is one of the steps
+ *  to write; the writing itself happens in the writer thread
+ ******************************************************************************/
+void write_frame(struct output *output, struct grid *grid, int step)
+{
+  if(!is_frame_step(output, step))
+    return;
+
+  output->sizes[output->filling] = 0;
+  if(output->format == FORMAT_ASCII)
+    append_ascii_frame(output, grid, step);
+  else if(output->format == FORMAT_RLE)
+    append_rle_frame(output, grid, step);
+  else
+    append_binary_frame(output, grid, step);
+
+  /* Wait for the writer to finish the frame before, then hand this one
+     over and build the next frame in the other buffer */
+  pthread_mutex_lock(&output->lock);
+  while(output->pending)
+    pthread_cond_wait(&output->cond, &output->lock);
+  output->pending = 1;
+  output->filling = 1 - output->filling;
+  pthread_cond_signal(&output->cond);
+  pthread_mutex_unlock(&output->lock);
+
+  return;
+}
+
+/*******************************************************************************
+ * Return the number of steps from this step to the next step to write after
+ *  it, or max_steps if that is sooner
+ ******************************************************************************/
+int steps_until_frame(struct output *output, int step, int max_steps)
+{
+  int steps;
+
+  if(output == NULL || output->format == FORMAT_NONE)
+    return max_steps;
+  steps = output->interval - step % output->interval;
+
+  return (steps < max_steps) ? steps : max_steps;
+}
+
+/*******************************************************************************
+ * A pattern read from a file: the size of its bounding box, the rule it asks
+ *  for (empty if none) and the row and column of each ALIVE cell
+ ******************************************************************************/
+struct pattern
+{
+  int num_rows;
+  int num_cols;
+  char rule[32];
+  int num_cells;
+  int max_cells;
+  int *rows;
+  int *cols;
+};
+
+/*****************************************
+ * Add a run of ALIVE cells to a pattern *
+ *****************************************/
+void add_pattern_cells(struct pattern *pattern, int row, int col, int count)
+{
+  while(count-- > 0)
+  {
+    if(pattern->num_cells == pattern->max_cells)
+    {
+      pattern->max_cells = 2 * pattern->max_cells + 64;
+      exit_if(((pattern->rows = (int*)realloc(pattern->rows,
+                pattern->max_cells * sizeof(int))) == NULL),
+          "realloc(pattern->rows)", 0);
+      exit_if(((pattern->cols = (int*)realloc(pattern->cols,
+                pattern->max_cells * sizeof(int))) == NULL),
+          "realloc(pattern->cols)", 0);
+    }
+    pattern->rows[pattern->num_cells] = row;
+    pattern->cols[pattern->num_cells] = col++;
+    pattern->num_cells++;
+    if(row + 1 > pattern->num_rows)
+      pattern->num_rows = row + 1;
+    if(col > pattern->num_cols)
+      pattern->num_cols = col;
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * Read a pattern from a file, either run-length encoded ("x = ..., y = ...,
+ *  rule = ..." then runs of b, o, $ and a closing !) or plain text (lines of
+ *  . and O, with ! starting a comment line). Lines starting with # are
+ *  comments in both. Return 0 on success, or print an error and return -1.
+ ******************************************************************************/
+int load_pattern(char *path, struct pattern *pattern)
+{
+  FILE *file;
+  char line[4096], *c;
+  int row = 0, col = 0, count, is_rle = -1, width = 0, height = 0;
+
+  memset(pattern, 0, sizeof(*pattern));
+  if((file = fopen(path, "r")) == NULL)
+  {
+    fprintf(stderr, "ERROR: cannot open pattern file %s\n", path);
+    return -1;
+  }
+
+  while(fgets(line, sizeof(line), file) != NULL)
+  {
+    if(line[0] == '#' || (is_rle != 1 && line[0] == '!'))
+      continue;
+
+    /* The first other line tells the formats apart */
+    if(is_rle == -1)
+    {
+      for(c = line; *c == ' ' || *c == '\t'; c++)
+        ;
+      is_rle = (*c == 'x');
+      if(is_rle)
+      {
+        sscanf(c, "x = %d , y = %d , rule = %31[^ \t\r\n]", &width, &height,
+            pattern->rule);
+        continue;
+      }
+    }
+
+    if(is_rle)
+    {
+      /* Runs carry on across lines until the ! */
+      for(c = line, count = 0; *c != '\0' && *c != '!'; c++)
+      {
+        if(*c >= '0' && *c <= '9')
+        {
+          count = 10 * count + (*c - '0');
+          continue;
+        }
+        if(count == 0)
+          count = 1;
+        if(*c == 'b' || *c == '.')
+          col += count;
+        else if(*c == '$')
+        {
+          row += count;
+          col = 0;
+        }
+        else if((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z'))
+        {
+          add_pattern_cells(pattern, row, col, count);
+          col += count;
+        }
+        count = 0;
+      }
+      if(*c == '!')
+        break;
+    }
+    else
+    {
+      for(c = line, col = 0; *c != '\0' && *c != '\r' && *c != '\n'; c++)
+      {
+        if(*c == 'O' || *c == 'o' || *c == '*')
+          add_pattern_cells(pattern, row, col, 1);
+        col++;
+      }
+      row++;
+      if(col > pattern->num_cols)
+        pattern->num_cols = col;
+    }
+  }
+  fclose(file);
+
+  /* Take the bounding box from the RLE header or the plain text's lines,
+   *  whichever is bigger */
+  if(width > pattern->num_cols)
+    pattern->num_cols = width;
+  if(height > pattern->num_rows)
+    pattern->num_rows = height;
+  if(!is_rle && row > pattern->num_rows)
+    pattern->num_rows = row;
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Place a pattern (which must fit) at the center of a grid
+ ******************************************************************************/
+void place_pattern(struct pattern *pattern, struct grid *grid)
+{
+  int i, row_offset, col_offset;
+
+  row_offset = 1 + (grid->num_rows - pattern->num_rows) / 2;
+  col_offset = 1 + (grid->num_cols - pattern->num_cols) / 2;
+  for(i = 0; i < pattern->num_cells; i++)
+    set_cell(grid, row_offset + pattern->rows[i],
+        col_offset + pattern->cols[i], ALIVE);
+
+  return;
+}
+
+/**************************
+ * Free a pattern's cells *
+ **************************/
+void free_pattern(struct pattern *pattern)
+{
+  free(pattern->rows);
+  free(pattern->cols);
+
+  return;
+}
+
+/*******************************************************************************
+ * Checkpoints. A checkpoint file is a header, padded to CHECKPOINT_DATA_OFFSET
+ *  bytes, followed by the grid's buffer exactly as it is laid out in memory
+ *  (ghost cells, padding and all). Restarting maps the file and, if the grid
+ *  has the same cell type and stride, copies the buffer straight back; there
+ *  is nothing to parse. Files are written to a temporary name and renamed, so
+ *  a run killed while writing leaves the last checkpoint intact.
+ ******************************************************************************/
+#define CHECKPOINT_MAGIC "LIFECKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_DATA_OFFSET 4096
+
+struct checkpoint_header
+{
+  char magic[8];
+  uint32_t version;
+  int32_t cell_type;
+  int32_t num_rows;
+  int32_t num_cols;
+  int32_t birth;
+  int32_t survival;
+  uint64_t step;
+  uint64_t stride;
+  uint64_t size;
+};
+
+/*******************************************************************************
+ * A checkpoint file mapped into memory, its header, and its buffer described
+ *  as a grid
+ ******************************************************************************/
+struct checkpoint
+{
+  void *map;
+  size_t map_size;
+  struct checkpoint_header *header;
+  struct grid grid;
+};
+
+/*******************************************************************************
+ * Create (or replace) a checkpoint file for a grid laid out like the given
+ *  one at the given step under the given rule, and map it. Return the
+ *  mapping; the buffer starts CHECKPOINT_DATA_OFFSET bytes in, and every cell
+ *  is DEAD.
+ ******************************************************************************/
+void *create_checkpoint(char *path, struct grid *grid, int step,
+    const struct rule *rule, size_t *map_size)
+{
+  struct checkpoint_header header;
+  size_t size = (size_t)(grid->num_rows + 2) * grid->stride;
+  void *map;
+  int fd;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = CHECKPOINT_VERSION;
+  header.cell_type = grid->cell_type;
+  header.num_rows = grid->num_rows;
+  header.num_cols = grid->num_cols;
+  header.birth = rule->birth;
+  header.survival = rule->survival;
+  header.step = step;
+  header.stride = grid->stride;
+  header.size = size;
+
+  *map_size = CHECKPOINT_DATA_OFFSET + size;
+  exit_if(((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0),
+      "open(checkpoint)", 0);
+  exit_if((ftruncate(fd, *map_size) != 0), "ftruncate(checkpoint)", 0);
+  exit_if(((map = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0)) == MAP_FAILED), "mmap(checkpoint)", 0);
+  close(fd);
+  memcpy(map, &header, sizeof(header));
+
+  return map;
+}
+
+/*******************************************************************************
+ * Write a grid at the given step under the given rule to a checkpoint file
+ ******************************************************************************/
+void write_checkpoint(char *path, struct grid *grid, int step,
+    const struct rule *rule)
+{
+  char *temp_path;
+  size_t map_size;
+  void *map;
+
+  exit_if(((temp_path = (char*)malloc(strlen(path) + 5)) == NULL),
+      "malloc(temp_path)", 0);
+  sprintf(temp_path, "%s.tmp", path);
+
+  map = create_checkpoint(temp_path, grid, step, rule, &map_size);
+  memcpy((char*)map + CHECKPOINT_DATA_OFFSET, grid->buffer,
+      map_size - CHECKPOINT_DATA_OFFSET);
+  exit_if((msync(map, map_size, MS_SYNC) != 0), "msync(checkpoint)", 0);
+  munmap(map, map_size);
+
+  exit_if((rename(temp_path, path) != 0), "rename(checkpoint)", 0);
+  free(temp_path);
+
+  return;
+}
+
+/*******************************************************************************
+ * Map a checkpoint file and check its header. Return 0 on success, or print
+ *  an error and return -1.
+ ******************************************************************************/
+int open_checkpoint(char *path, struct checkpoint *checkpoint)
+{
+  struct stat file_stat;
+  int fd;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &file_stat) != 0)
+  {
+    fprintf(stderr, "ERROR: cannot open checkpoint file %s\n", path);
+    return -1;
+  }
+
+  checkpoint->map_size = file_stat.st_size;
+  checkpoint->map = MAP_FAILED;
+  if(checkpoint->map_size >= CHECKPOINT_DATA_OFFSET)
+    checkpoint->map = mmap(NULL, checkpoint->map_size, PROT_READ, MAP_PRIVATE,
+        fd, 0);
+  close(fd);
+  if(checkpoint->map == MAP_FAILED)
+  {
+    fprintf(stderr, "ERROR: %s is not a checkpoint file\n", path);
+    return -1;
+  }
+
+  checkpoint->header = (struct checkpoint_header*)checkpoint->map;
+  layout_grid(&checkpoint->grid, checkpoint->header->num_rows,
+      checkpoint->header->num_cols, checkpoint->header->cell_type);
+  checkpoint->grid.buffer = (unsigned char*)checkpoint->map
+    + CHECKPOINT_DATA_OFFSET;
+  if(memcmp(checkpoint->header->magic, CHECKPOINT_MAGIC,
+        sizeof(checkpoint->header->magic)) != 0
+      || checkpoint->header->version != CHECKPOINT_VERSION
+      || checkpoint->header->cell_type < CELL_UINT8
+      || checkpoint->header->cell_type > CELL_BIT
+      || checkpoint->header->num_rows < 1 || checkpoint->header->num_cols < 1
+      || checkpoint->header->stride != checkpoint->grid.stride
+      || checkpoint->header->size != checkpoint->grid.size
+      || CHECKPOINT_DATA_OFFSET + checkpoint->header->size
+      > checkpoint->map_size)
+  {
+    fprintf(stderr, "ERROR: %s is not a version %d checkpoint file\n", path,
+        CHECKPOINT_VERSION);
+    munmap(checkpoint->map, checkpoint->map_size);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Copy rows row_begin up to row_end of a checkpoint into a grid of the same
+ *  size, straight across if it has the same layout and cell by cell if not
+ ******************************************************************************/
+void restore_checkpoint(struct checkpoint *checkpoint, struct grid *grid,
+    int row_begin, int row_end)
+{
+  int row, col;
+
+  if(checkpoint->grid.cell_type == grid->cell_type)
+  {
+    memcpy(grid->buffer + (size_t)row_begin * grid->stride,
+        checkpoint->grid.buffer + (size_t)row_begin * grid->stride,
+        (size_t)(row_end - row_begin) * grid->stride);
+    return;
+  }
+
+  for(row = row_begin; row < row_end; row++)
+    for(col = 1; col <= grid->num_cols; col++)
+      set_cell(grid, row, col, get_cell(&checkpoint->grid, row, col));
+
+  return;
+}
+
+/***************************
+ * Unmap a checkpoint file *
+ ***************************/
+void close_checkpoint(struct checkpoint *checkpoint)
+{
+  munmap(checkpoint->map, checkpoint->map_size);
+
+  return;
+}
+
+/*******************************************************************************
+ * Out-of-core streaming. The grid lives in a checkpoint file mapped into
+ *  memory, and each pass reads it in bands of rows into a small window (the
+ *  band plus a halo of num_steps rows above and below, wrapping around the
+ *  torus), advances the window num_steps steps and writes the band to a
+ *  second file; the files then swap places. Only the window, and the pages of
+ *  the band in flight, need to be resident: the kernel is asked to start
+ *  reading the next band's rows while this one is computed, and to drop the
+ *  rows behind it once they are done.
+ ******************************************************************************/
+
+/*******************************************************************************
+ * Give the kernel advice about rows row_begin up to row_end of a grid mapped
+ *  from a file
+ ******************************************************************************/
+void advise_rows(struct grid *grid, int row_begin, int row_end, int advice)
+{
+  uintptr_t page_size = sysconf(_SC_PAGESIZE), begin, end;
+
+  if(row_begin < 0)
+    row_begin = 0;
+  if(row_end > grid->num_rows + 2)
+    row_end = grid->num_rows + 2;
+  if(row_begin >= row_end)
+    return;
+
+  begin = (uintptr_t)(grid->buffer + (size_t)row_begin * grid->stride)
+    & ~(page_size - 1);
+  end = (uintptr_t)(grid->buffer + (size_t)row_end * grid->stride);
+  madvise((void*)begin, end - begin, advice);
+
+  return;
+}
+
+/*******************************************************************************
+ * Allocate the two window grids for bands of band_rows rows of the given
+ *  grid with halos for depth steps
+ ******************************************************************************/
+void alloc_window_grids(struct grid window[2], struct grid *grid,
+    int band_rows, int depth)
+{
+  int i;
+
+  for(i = 0; i < 2; i++)
+    alloc_grid(&window[i], band_rows + 2 * depth, grid->num_cols,
+        grid->cell_type);
+
+  return;
+}
+
+/*******************************************************************************
+ * Advance rows row_begin up to row_end of the source grid by num_steps steps
+ *  into the target grid, using the window grids
+ ******************************************************************************/
+void step_stream_band(struct grid *source, struct grid *target,
+    struct grid window[2], int num_steps, int row_begin, int row_end,
+    const struct rule *rule)
+{
+  struct grid *current = &window[0], *next = &window[1], *temp;
+  int num_rows = row_end - row_begin, unit_begin, unit_end, local_row, row,
+      step;
+
+  /* Size the windows for this band; they were allocated for the largest */
+  window[0].num_rows = window[1].num_rows = num_rows + 2 * num_steps;
+
+  /* Copy the band and its halo, whole rows at a time (local row 0 is global
+   *  row row_begin - num_steps - 1), then wrap the columns */
+  for(local_row = 0; local_row <= num_rows + 2 * num_steps + 1; local_row++)
+    memcpy(grid_row(current, local_row), grid_row(source,
+          wrap_index(row_begin - num_steps - 1 + local_row,
+            source->num_rows)), source->row_bytes);
+  update_ghost_columns(current, 0, num_rows + 2 * num_steps + 2);
+
+  /* Advance the window, computing one less row at each end every step; the
+   *  rows span the whole torus, so their ghost columns are exact */
+  get_grid_units(current, &unit_begin, &unit_end);
+  for(step = 1; step <= num_steps; step++)
+  {
+#pragma omp parallel for
+    for(row = step; row < num_rows + 2 * num_steps + 2 - step; row++)
+    {
+      step_block(current, next, row, row + 1, unit_begin, unit_end, rule);
+    }
+    update_ghost_columns(next, step, num_rows + 2 * num_steps + 2 - step);
+    temp = current;
+    current = next;
+    next = temp;
+  }
+
+  /* Copy the band back out of the window */
+  for(row = row_begin; row < row_end; row++)
+    memcpy(grid_row(target, row),
+        grid_row(current, row - row_begin + num_steps + 1),
+        target->row_bytes);
+
+  return;
+}
+
+/*******************************************************************************
+ * Advance the source grid by num_steps steps into the target grid, one band
+ *  of band_rows rows at a time
+ ******************************************************************************/
+void step_stream(struct grid *source, struct grid *target,
+    struct grid window[2], int band_rows, int num_steps,
+    const struct rule *rule)
+{
+  int row_begin, row_end;
+
+  for(row_begin = 1; row_begin <= source->num_rows; row_begin = row_end)
+  {
+    row_end = row_begin + band_rows;
+    if(row_end > source->num_rows + 1)
+      row_end = source->num_rows + 1;
+
+    /* Start reading the next band while this one is computed */
+    advise_rows(source, row_end + num_steps + 1,
+        row_end + band_rows + num_steps + 1, MADV_WILLNEED);
+    step_stream_band(source, target, window, num_steps, row_begin, row_end,
+        rule);
+
+    /* The next band starts num_steps + 1 rows above its first row; drop
+     *  the source rows before that and the finished target rows (dirty
+     *  pages stay in the page cache until they are written back) */
+    advise_rows(source, row_begin - num_steps - 1, row_end - num_steps - 1,
+        MADV_DONTNEED);
+    advise_rows(target, row_begin, row_end, MADV_DONTNEED);
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * A HashLife quadtree node. A node at level L is a square of 2^L x 2^L cells
+ *  made of four level L-1 children; the two level 0 nodes are single cells.
+ *  Nodes are hash-consed, so equal squares are the same node, and each node
+ *  remembers its result: its center square, advanced 2^min(LOG2_STEP, L-2)
+ *  generations.
+ ******************************************************************************/
+struct hashlife_node
+{
+  struct hashlife_node *nw, *ne, *sw, *se;
+  struct hashlife_node *result;
+  struct hashlife_node *next;  /* next node in a hash bucket or free list */
+  uint64_t population;
+  int level;                   /* -1 for nodes on the free list */
+  int marked;
+};
+
+/* Nodes are allocated in blocks of this many */
+#define HASHLIFE_NODES_PER_BLOCK 65536
+
+/* The universe can grow to 2^HASHLIFE_MAX_LEVEL cells on a side */
+#define HASHLIFE_MAX_LEVEL 63
+
+struct hashlife_block
+{
+  struct hashlife_block *next;
+  struct hashlife_node nodes[HASHLIFE_NODES_PER_BLOCK];
+};
+
+/*******************************************************************************
+ * A HashLife universe: the node store (blocks, free list and hash table), the
+ *  empty square of every level, and the root, whose center is cell (0, 0)
+ ******************************************************************************/
+struct hashlife
+{
+  struct hashlife_node dead_leaf, alive_leaf;
+  struct hashlife_node *empty[HASHLIFE_MAX_LEVEL + 1];
+  struct hashlife_node **buckets;
+  size_t num_buckets;
+  size_t num_nodes;
+  size_t max_bytes;
+  struct hashlife_node *free_nodes;
+  struct hashlife_block *blocks;
+  struct hashlife_node *root;
+  const struct rule *rule;
+  int log2_step;
+  int num_collections;
+};
+
+/*********************************************************
+ * Return the bucket of the node with the given children *
+ *********************************************************/
+size_t hashlife_hash(struct hashlife *hl, struct hashlife_node *nw,
+    struct hashlife_node *ne, struct hashlife_node *sw,
+    struct hashlife_node *se)
+{
+  uint64_t hash = (uintptr_t)nw;
+
+  hash = hash * 0x9E3779B97F4A7C15ULL + (uintptr_t)ne;
+  hash = hash * 0x9E3779B97F4A7C15ULL + (uintptr_t)sw;
+  hash = hash * 0x9E3779B97F4A7C15ULL + (uintptr_t)se;
+
+  return (hash ^ (hash >> 29)) & (hl->num_buckets - 1);
+}
+
+/*****************************************************************
+ * Double the hash table and move every node into its new bucket *
+ *****************************************************************/
+void hashlife_grow_table(struct hashlife *hl)
+{
+  struct hashlife_node **old_buckets = hl->buckets;
+  struct hashlife_node *node, *next;
+  size_t old_num_buckets = hl->num_buckets, bucket;
+
+  hl->num_buckets *= 2;
+  exit_if(((hl->buckets = (struct hashlife_node**)calloc(hl->num_buckets,
+            sizeof(struct hashlife_node*))) == NULL),
+      "calloc(hashlife buckets)", 0);
+  for(bucket = 0; bucket < old_num_buckets; bucket++)
+  {
+    for(node = old_buckets[bucket]; node != NULL; node = next)
+    {
+      next = node->next;
+      node->next = hl->buckets[hashlife_hash(hl, node->nw, node->ne,
+          node->sw, node->se)];
+      hl->buckets[hashlife_hash(hl, node->nw, node->ne, node->sw,
+          node->se)] = node;
+    }
+  }
+  free(old_buckets);
+
+  return;
+}
+
+/*******************************************************************************
+ * Return the node with the given children, creating it if it does not exist
+ ******************************************************************************/
+struct hashlife_node *hashlife_join(struct hashlife *hl,
+    struct hashlife_node *nw, struct hashlife_node *ne,
+    struct hashlife_node *sw, struct hashlife_node *se)
+{
+  struct hashlife_node *node;
+  struct hashlife_block *block;
+  size_t bucket = hashlife_hash(hl, nw, ne, sw, se);
+  int i;
+
+  for(node = hl->buckets[bucket]; node != NULL; node = node->next)
+  {
+    if(node->nw == nw && node->ne == ne && node->sw == sw && node->se == se)
+      return node;
+  }
+
+  /* Take a node from the free list, allocating another block if needed */
+  if(hl->free_nodes == NULL)
+  {
+    exit_if(((block = (struct hashlife_block*)malloc(
+              sizeof(struct hashlife_block))) == NULL),
+        "malloc(hashlife block)", 0);
+    block->next = hl->blocks;
+    hl->blocks = block;
+    for(i = HASHLIFE_NODES_PER_BLOCK - 1; i >= 0; i--)
+    {
+      block->nodes[i].level = -1;
+      block->nodes[i].marked = 0;
+      block->nodes[i].next = hl->free_nodes;
+      hl->free_nodes = &block->nodes[i];
+    }
+  }
+  node = hl->free_nodes;
+  hl->free_nodes = node->next;
+
+  node->nw = nw;
+  node->ne = ne;
+  node->sw = sw;
+  node->se = se;
+  node->result = NULL;
+  node->population = nw->population + ne->population + sw->population
+    + se->population;
+  node->level = nw->level + 1;
+  node->next = hl->buckets[bucket];
+  hl->buckets[bucket] = node;
+
+  hl->num_nodes++;
+  if(hl->num_nodes > hl->num_buckets)
+    hashlife_grow_table(hl);
+
+  return node;
+}
+
+/****************************************************************
+ * Return the number of bytes the node store is currently using *
+ ****************************************************************/
+size_t hashlife_bytes(struct hashlife *hl)
+{
+  return hl->num_nodes * sizeof(struct hashlife_node)
+    + hl->num_buckets * sizeof(struct hashlife_node*);
+}
+
+/*******************************************************
+ * Mark a node and every node below it as still in use *
+ *******************************************************/
+void hashlife_mark(struct hashlife_node *node)
+{
+  if(node->marked)
+    return;
+  node->marked = 1;
+  hashlife_mark(node->nw);
+  hashlife_mark(node->ne);
+  hashlife_mark(node->sw);
+  hashlife_mark(node->se);
+
+  return;
+}
+
+/*******************************************************************************
+ * Collect garbage: keep the nodes reachable from the root and the empty
+ *  squares, evict every remembered result that points at a node that is not
+ *  kept, and put everything else back on the free list
+ ******************************************************************************/
+void hashlife_collect(struct hashlife *hl)
+{
+  struct hashlife_block *block;
+  struct hashlife_node *node;
+  size_t bucket;
+  int level, i;
+
+  hashlife_mark(hl->root);
+  for(level = 1; level <= HASHLIFE_MAX_LEVEL; level++)
+    hashlife_mark(hl->empty[level]);
+
+  /* Evict results first, while every node's mark is still valid */
+  for(block = hl->blocks; block != NULL; block = block->next)
+  {
+    for(i = 0; i < HASHLIFE_NODES_PER_BLOCK; i++)
+    {
+      node = &block->nodes[i];
+      if(node->level > 0 && node->marked && node->result != NULL
+          && !node->result->marked)
+        node->result = NULL;
+    }
+  }
+
+  /* Rebuild the hash table from the kept nodes */
+  for(bucket = 0; bucket < hl->num_buckets; bucket++)
+    hl->buckets[bucket] = NULL;
+  hl->num_nodes = 0;
+  for(block = hl->blocks; block != NULL; block = block->next)
+  {
+    for(i = 0; i < HASHLIFE_NODES_PER_BLOCK; i++)
+    {
+      node = &block->nodes[i];
+      if(node->level <= 0)
+        continue;
+      if(node->marked)
+      {
+        node->marked = 0;
+        bucket = hashlife_hash(hl, node->nw, node->ne, node->sw, node->se);
+        node->next = hl->buckets[bucket];
+        hl->buckets[bucket] = node;
+        hl->num_nodes++;
+      }
+      else
+      {
+        node->level = -1;
+        node->next = hl->free_nodes;
+        hl->free_nodes = node;
+      }
+    }
+  }
+  hl->num_collections++;
+
+  return;
+}
+
+/*******************************************************************************
+ * Set up an empty universe following a rule, whose node store may use up to
+ *  max_bytes (checked between steps) before it is garbage collected
+ ******************************************************************************/
+void hashlife_init(struct hashlife *hl, const struct rule *rule, int log2_step,
+    size_t max_bytes)
+{
+  int level;
+
+  memset(hl, 0, sizeof(*hl));
+  hl->rule = rule;
+  hl->log2_step = log2_step;
+  hl->max_bytes = max_bytes;
+
+  /* The leaves are never collected, so they stay marked */
+  hl->dead_leaf.population = 0;
+  hl->alive_leaf.population = 1;
+  hl->dead_leaf.marked = hl->alive_leaf.marked = 1;
+
+  hl->num_buckets = 1024;
+  exit_if(((hl->buckets = (struct hashlife_node**)calloc(hl->num_buckets,
+            sizeof(struct hashlife_node*))) == NULL),
+      "calloc(hashlife buckets)", 0);
+
+  hl->empty[0] = &hl->dead_leaf;
+  for(level = 1; level <= HASHLIFE_MAX_LEVEL; level++)
+    hl->empty[level] = hashlife_join(hl, hl->empty[level - 1],
+        hl->empty[level - 1], hl->empty[level - 1], hl->empty[level - 1]);
+
+  return;
+}
+
+/**************************************
+ * Deallocate a universe's node store *
+ **************************************/
+void hashlife_free(struct hashlife *hl)
+{
+  struct hashlife_block *block, *next;
+
+  for(block = hl->blocks; block != NULL; block = next)
+  {
+    next = block->next;
+    free(block);
+  }
+  free(hl->buckets);
+
+  return;
+}
+
+/*******************************************************************************
+ * Build the node at the given level whose top-left cell is at (x, y), taking
+ *  the cells of the grid's non-ghost area to be at (0, 0) to
+ *  (num_cols - 1, num_rows - 1) and every other cell to be DEAD
+ ******************************************************************************/
+struct hashlife_node *hashlife_build(struct hashlife *hl, struct grid *grid,
+    int level, int64_t x, int64_t y)
+{
+  int64_t half;
+
+  if(x >= grid->num_cols || y >= grid->num_rows
+      || x + ((int64_t)1 << level) <= 0 || y + ((int64_t)1 << level) <= 0)
+    return hl->empty[level];
+  if(level == 0)
+    return (get_cell(grid, y + 1, x + 1) == ALIVE)
+      ? &hl->alive_leaf : &hl->dead_leaf;
+
+  half = (int64_t)1 << (level - 1);
+  return hashlife_join(hl,
+      hashlife_build(hl, grid, level - 1, x, y),
+      hashlife_build(hl, grid, level - 1, x + half, y),
+      hashlife_build(hl, grid, level - 1, x, y + half),
+      hashlife_build(hl, grid, level - 1, x + half, y + half));
+}
+
+/*******************************************************************************
+ * Get the state of the cell at (x, y), counted from a node's top-left corner
+ ******************************************************************************/
+int hashlife_get_cell(struct hashlife_node *node, uint64_t x, uint64_t y)
+{
+  uint64_t half;
+
+  while(node->level > 0)
+  {
+    if(node->population == 0)
+      return DEAD;
+    half = (uint64_t)1 << (node->level - 1);
+    if(y < half)
+      node = (x < half) ? node->nw : node->ne;
+    else
+      node = (x < half) ? node->sw : node->se;
+    x %= half;
+    y %= half;
+  }
+
+  return (node->population == 1) ? ALIVE : DEAD;
+}
+
+/*******************************************************************************
+ * Return the center of a level 2 node advanced one generation, found by
+ *  applying the rule to each of its four center cells
+ ******************************************************************************/
+struct hashlife_node *hashlife_base_result(struct hashlife *hl,
+    struct hashlife_node *node)
+{
+  struct hashlife_node *centers[4];
+  int x, y, neighbor_x, neighbor_y, num_alive_neighbors, state;
+
+  for(y = 1; y <= 2; y++)
+  {
+    for(x = 1; x <= 2; x++)
+    {
+      num_alive_neighbors = 0;
+      for(neighbor_y = y - 1; neighbor_y <= y + 1; neighbor_y++)
+        for(neighbor_x = x - 1; neighbor_x <= x + 1; neighbor_x++)
+          if(neighbor_x != x || neighbor_y != y)
+            num_alive_neighbors += hashlife_get_cell(node, neighbor_x,
+                neighbor_y);
+
+      state = hl->rule->next_state[hashlife_get_cell(node, x, y)]
+        [num_alive_neighbors];
+      centers[(y - 1) * 2 + (x - 1)] = (state == ALIVE)
+        ? &hl->alive_leaf : &hl->dead_leaf;
+    }
+  }
+
+  return hashlife_join(hl, centers[0], centers[1], centers[2], centers[3]);
+}
+
+/*******************************************************************************
+ * Return the center of a node (one level down) without advancing it
+ ******************************************************************************/
+struct hashlife_node *hashlife_center(struct hashlife *hl,
+    struct hashlife_node *node)
+{
+  return hashlife_join(hl, node->nw->se, node->ne->sw, node->sw->ne,
+      node->se->nw);
+}
+
+/*******************************************************************************
+ * Return a node's result: its center, advanced 2^min(LOG2_STEP, L-2)
+ *  generations. The node is split into nine overlapping subsquares one level
+ *  down; at full speed each is advanced (a quarter of the time) and then the
+ *  four overlapping groups of those are advanced again (the other quarter),
+ *  while for a shorter step the subsquares are only centered and the whole
+ *  step happens in the second stage.
+ ******************************************************************************/
+struct hashlife_node *hashlife_result(struct hashlife *hl,
+    struct hashlife_node *node)
+{
+  struct hashlife_node *n00, *n01, *n02, *n10, *n11, *n12, *n20, *n21, *n22;
+  struct hashlife_node *(*first_stage)(struct hashlife*,
+      struct hashlife_node*);
+
+  if(node->result != NULL)
+    return node->result;
+
+  if(node->population == 0)
+    node->result = hl->empty[node->level - 1];
+  else if(node->level == 2)
+    node->result = hashlife_base_result(hl, node);
+  else
+  {
+    first_stage = (node->level - 2 <= hl->log2_step)
+      ? hashlife_result : hashlife_center;
+
+    n00 = first_stage(hl, node->nw);
+    n01 = first_stage(hl, hashlife_join(hl, node->nw->ne, node->ne->nw,
+          node->nw->se, node->ne->sw));
+    n02 = first_stage(hl, node->ne);
+    n10 = first_stage(hl, hashlife_join(hl, node->nw->sw, node->nw->se,
+          node->sw->nw, node->sw->ne));
+    n11 = first_stage(hl, hashlife_center(hl, node));
+    n12 = first_stage(hl, hashlife_join(hl, node->ne->sw, node->ne->se,
+          node->se->nw, node->se->ne));
+    n20 = first_stage(hl, node->sw);
+    n21 = first_stage(hl, hashlife_join(hl, node->sw->ne, node->se->nw,
+          node->sw->se, node->se->sw));
+    n22 = first_stage(hl, node->se);
+
+    node->result = hashlife_join(hl,
+        hashlife_result(hl, hashlife_join(hl, n00, n01, n10, n11)),
+        hashlife_result(hl, hashlife_join(hl, n01, n02, n11, n12)),
+        hashlife_result(hl, hashlife_join(hl, n10, n11, n20, n21)),
+        hashlife_result(hl, hashlife_join(hl, n11, n12, n21, n22)));
+  }
+
+  return node->result;
+}
+
+/*******************************************************************************
+ * Surround a node with empty space, returning a node one level up with the
+ *  same center
+ ******************************************************************************/
+struct hashlife_node *hashlife_expand(struct hashlife *hl,
+    struct hashlife_node *node)
+{
+  struct hashlife_node *empty = hl->empty[node->level - 1];
+
+  return hashlife_join(hl,
+      hashlife_join(hl, empty, empty, empty, node->nw),
+      hashlife_join(hl, empty, empty, node->ne, empty),
+      hashlife_join(hl, empty, node->sw, empty, empty),
+      hashlife_join(hl, node->se, empty, empty, empty));
+}
+
+/*******************************************************************************
+ * Return 1 if all of a node's live cells are in its center square
+ ******************************************************************************/
+int hashlife_is_padded(struct hashlife_node *node)
+{
+  return node->nw->population == node->nw->se->population
+    && node->ne->population == node->ne->sw->population
+    && node->sw->population == node->sw->ne->population
+    && node->se->population == node->se->nw->population;
+}
+
+/*******************************************************************************
+ * Advance the universe 2^LOG2_STEP generations. The root is padded until the
+ *  pattern cannot reach its edge in that time, and one more level so its
+ *  result covers the same area, then replaced by its result.
+ ******************************************************************************/
+void hashlife_step(struct hashlife *hl)
+{
+  if(hashlife_bytes(hl) > hl->max_bytes)
+    hashlife_collect(hl);
+
+  while(hl->root->level < hl->log2_step + 2 || !hashlife_is_padded(hl->root))
+  {
+    exit_if((hl->root->level >= HASHLIFE_MAX_LEVEL - 1),
+        "hashlife_step (universe too large)", 0);
+    hl->root = hashlife_expand(hl, hl->root);
+  }
+  hl->root = hashlife_result(hl, hashlife_expand(hl, hl->root));
+
+  return;
+}
+
+/*******************************************************************************
+ * Copy the cells at (-1, -1) to (num_cols, num_rows) into a grid, so the grid
+ *  shows the original board's area and the cells just outside it as ghosts
+ ******************************************************************************/
+void hashlife_to_grid(struct hashlife *hl, struct grid *grid)
+{
+  uint64_t corner = (uint64_t)1 << (hl->root->level - 1);
+  int row, col;
+
+  for(row = 0; row <= grid->num_rows + 1; row++)
+  {
+    for(col = 0; col <= grid->num_cols + 1; col++)
+    {
+      /* Count from the root's top-left corner, which is at (-corner,
+         -corner); cells beyond the root are DEAD */
+      if((uint64_t)(col - 1) + corner < 2 * corner
+          && (uint64_t)(row - 1) + corner < 2 * corner)
+        set_cell(grid, row, col, hashlife_get_cell(hl->root,
+              (uint64_t)(col - 1) + corner, (uint64_t)(row - 1) + corner));
+      else
+        set_cell(grid, row, col, DEAD);
+    }
+  }
+
+  return;
+}
+
+/*******************************************************************************
+ * The settings chosen on the command line
+ ******************************************************************************/
+struct settings
+{
+  int num_rows;
+  int num_cols;
+  int num_steps;
+  int engine;
+  int cell_type;
+  int num_threads;
+  int log2_step;       /* hashlife: each time step is 2^log2_step gens */
+  int node_cache_mb;   /* hashlife: node store size that triggers GC */
+  int tile_size;       /* active-region tracking tile size, 0 for none */
+  int block_size;      /* temporal blocking block size, 0 for none */
+  int depth;           /* temporal blocking: steps per block */
+  int isa;             /* instruction set for the bit steppers */
+  struct rule rule;
+  struct pattern *pattern;        /* starting pattern, NULL for random */
+  struct checkpoint *restart;     /* checkpoint to start from, or NULL */
+  char *checkpoint_path;          /* where to write checkpoints, or NULL */
+  int checkpoint_interval;        /* steps between checkpoints, 0 for end */
+  char *stream_path;              /* out-of-core grid file, or NULL */
+  int band_rows;                  /* streaming: rows per band */
+};
+
+/*******************************************************************************
+ * Return the number of steps to advance at once from this step when a run
+ *  takes DEPTH steps at a time: no more than that, and no further than the
+ *  last step, the next step to write or the next checkpoint
+ ******************************************************************************/
+int steps_until_stop(struct settings *settings, struct output *output,
+    int step)
+{
+  int steps = settings->num_steps - step;
+
+  if(steps > settings->depth)
+    steps = settings->depth;
+  steps = steps_until_frame(output, step, steps);
+  if(settings->checkpoint_interval > 0 && steps > settings->checkpoint_interval
+      - step % settings->checkpoint_interval)
+    steps = settings->checkpoint_interval - step % settings->checkpoint_interval;
+
+  return steps;
+}
+
+/*******************************************************************************
+ * Run HashLife from the given grid for the specified number of time steps of
+ *  2^LOG2_STEP generations each, on an unbounded plane rather than a torus.
+ *  Write the original board's area to the output (if any) at its steps.
+ *  Return the number of seconds spent in the time-step loop.
+ ******************************************************************************/
+double run_hashlife(struct settings *settings, struct grid *grid,
+    struct output *output)
+{
+  struct hashlife hl;
+  int level, step;
+  double start_time, end_time;
+
+  hashlife_init(&hl, &settings->rule, settings->log2_step,
+      (size_t)settings->node_cache_mb * 1024 * 1024);
+
+  /* Make the root big enough that its center is (0, 0) and it holds the
+   *  whole board */
+  for(level = 3; ((int64_t)1 << (level - 1)) < grid->num_rows
+      || ((int64_t)1 << (level - 1)) < grid->num_cols; level++)
+    ;
+  hl.root = hashlife_build(&hl, grid, level, -((int64_t)1 << (level - 1)),
+      -((int64_t)1 << (level - 1)));
+
+  start_time = omp_get_wtime();
+  for(step = 0; step <= settings->num_steps - 1; step++)
+  {
+    if(is_frame_step(output, step))
+    {
+      hashlife_to_grid(&hl, grid);
+      write_frame(output, grid, step);
+    }
+    hashlife_step(&hl);
+  }
+  end_time = omp_get_wtime();
+
+  if(output != NULL)
+    fprintf(stderr, "Generation %llu: population %llu (%d garbage collections)\n",
+        (unsigned long long)settings->num_steps << settings->log2_step,
+        (unsigned long long)hl.root->population, hl.num_collections);
+
+  hashlife_free(&hl);
+
+  return end_time - start_time;
+}
+
+/*******************************************************************************
+ * Initialize a grid from the checkpoint or pattern if there is one, or else
+ *  give each cell a random state, drawn in the same order for every cell type
+ *  so a given seed gives the same board. A grid mapped from a file is filled
+ *  band_rows rows at a time, dropping each band once it is done; pass 0 for
+ *  a grid in memory. Return the step the grid is at.
+ ******************************************************************************/
+int init_grid(struct settings *settings, struct grid *grid, int band_rows)
+{
+  int row, col, row_begin, row_end;
+
+  if(settings->pattern != NULL)
+  {
+    place_pattern(settings->pattern, grid);
+    return 0;
+  }
+
+  for(row_begin = 1; row_begin <= grid->num_rows; row_begin = row_end)
+  {
+    row_end = (band_rows > 0) ? row_begin + band_rows : grid->num_rows + 1;
+    if(row_end > grid->num_rows + 1)
+      row_end = grid->num_rows + 1;
+
+    if(settings->restart != NULL)
+      restore_checkpoint(settings->restart, grid, row_begin, row_end);
+    else
+    {
+      for(row = row_begin; row < row_end; row++)
+      {
+        for(col = 1; col <= grid->num_cols; col++)
+        {
+          set_cell(grid, row, col, random() % (ALIVE + 1));
+        }
+      }
+    }
+
+    if(band_rows > 0)
+    {
+      advise_rows(grid, row_begin, row_end, MADV_DONTNEED);
+      if(settings->restart != NULL)
+        advise_rows(&settings->restart->grid, row_begin, row_end,
+            MADV_DONTNEED);
+    }
+  }
+
+  return (settings->restart != NULL) ? settings->restart->header->step : 0;
+}
+
+/*******************************************************************************
+ * Run the simulation out of core, in settings->stream_path and a second file
+ *  beside it, for the specified number of time steps, writing the grid to the
+ *  output (if any) at its steps. The file is left holding the final grid as
+ *  a checkpoint. Return the number of seconds spent in the time-step loop.
+ ******************************************************************************/
+double run_streaming(struct settings *settings, struct output *output)
+{
+  int CHECKPOINT_INTERVAL = settings->checkpoint_interval;
+  int step, first_step, steps_taken;
+  struct grid grids[2], window[2], *source = &grids[0], *target = &grids[1],
+    *temp;
+  void *maps[2];
+  size_t map_size;
+  char *next_path;
+  double start_time, end_time;
+
+  exit_if(((next_path = (char*)malloc(strlen(settings->stream_path) + 6))
+        == NULL), "malloc(next_path)", 0);
+  sprintf(next_path, "%s.next", settings->stream_path);
+
+  /* Start in the second file, so a checkpoint being restarted from can be
+   *  the stream file itself; only once it is copied is the stream file
+   *  replaced */
+  layout_grid(&grids[0], settings->num_rows, settings->num_cols,
+      settings->cell_type);
+  grids[1] = grids[0];
+  maps[0] = create_checkpoint(next_path, &grids[0], 0, &settings->rule,
+      &map_size);
+  grids[0].buffer = (unsigned char*)maps[0] + CHECKPOINT_DATA_OFFSET;
+  first_step = init_grid(settings, &grids[0], settings->band_rows);
+  ((struct checkpoint_header*)maps[0])->step = first_step;
+  maps[1] = create_checkpoint(settings->stream_path, &grids[1], first_step,
+      &settings->rule, &map_size);
+  grids[1].buffer = (unsigned char*)maps[1] + CHECKPOINT_DATA_OFFSET;
+
+  alloc_window_grids(window, source, settings->band_rows, settings->depth);
+
+  /* Run the simulation for the specified number of time steps, up to DEPTH
+     at a time */
+  start_time = omp_get_wtime();
+  for(step = first_step; step <= settings->num_steps - 1;
+      step += steps_taken)
+  {
+    /* Write the current grid, and checkpoint it every CHECKPOINT_INTERVAL
+       steps */
+    if(is_frame_step(output, step))
+    {
+      update_ghosts(source);
+      write_frame(output, source, step);
+    }
+    if(CHECKPOINT_INTERVAL > 0 && step > first_step
+        && step % CHECKPOINT_INTERVAL == 0)
+      write_checkpoint(settings->checkpoint_path, source, step,
+          &settings->rule);
+
+    steps_taken = steps_until_stop(settings, output, step);
+    step_stream(source, target, window, settings->band_rows, steps_taken,
+        &settings->rule);
+
+    /* The target file now holds the current grid */
+    ((struct checkpoint_header*)maps[target - grids])->step
+      = step + steps_taken;
+    temp = source;
+    source = target;
+    target = temp;
+  }
+  end_time = omp_get_wtime();
+
+  /* Checkpoint the final grid */
+  if(settings->checkpoint_path != NULL)
+    write_checkpoint(settings->checkpoint_path, source, step,
+        &settings->rule);
+
+  /* Leave the final grid in the stream file */
+  exit_if((msync(maps[source - grids], map_size, MS_SYNC) != 0),
+      "msync(stream)", 0);
+  if(source == &grids[0])
+    exit_if((rename(next_path, settings->stream_path) != 0),
+        "rename(stream)", 0);
+  else
+    unlink(next_path);
+  munmap(maps[0], map_size);
+  munmap(maps[1], map_size);
+
+  free_grid(&window[1]);
+  free_grid(&window[0]);
+  free(next_path);
+
+  return end_time - start_time;
+}
+
+/*******************************************************************************
+ * Run the simulation with the chosen engine and cell type for the specified
+ *  number of time steps, writing the grid to the output (if any) at its
+ *  steps. Return the number of seconds spent in the time-step loop.
+ ******************************************************************************/
+double run_simulation(struct settings *settings, struct output *output)
+{
+  int NUM_ROWS = settings->num_rows, NUM_COLS = settings->num_cols;
+  int CHECKPOINT_INTERVAL = settings->checkpoint_interval;
+  int step, first_step, steps_taken, thread;
+  struct grid current_grid, next_grid, temp_grid;
+  struct grid *local_grids = NULL;
+  struct tiles tiles;
+  double start_time, end_time;
+
+  if(settings->stream_path != NULL)
+    return run_streaming(settings, output);
+
+  /* Allocate the current grid and next grid, including the ghost rows and
+   *  columns */
+  alloc_grid(&current_grid, NUM_ROWS, NUM_COLS, settings->cell_type);
+  alloc_grid(&next_grid, NUM_ROWS, NUM_COLS, settings->cell_type);
+
+  /* Initialize the grid */
+  first_step = init_grid(settings, &current_grid, 0);
+
+  if(settings->engine == ENGINE_HASHLIFE)
+  {
+    start_time = 0.0;
+    end_time = run_hashlife(settings, &current_grid, output);
+  }
+  else
+  {
+    if(settings->tile_size > 0)
+      alloc_tiles(&tiles, &current_grid, settings->tile_size);
+    if(settings->block_size > 0)
+    {
+      exit_if(((local_grids = (struct grid*)malloc(2 * omp_get_max_threads()
+                * sizeof(struct grid))) == NULL), "malloc(local_grids)", 0);
+      for(thread = 0; thread < omp_get_max_threads(); thread++)
+        alloc_local_grids(&local_grids[2 * thread], &current_grid,
+            settings->block_size, settings->depth);
+    }
+
+    /* Run the simulation for the specified number of time steps */
+    start_time = omp_get_wtime();
+    for(step = first_step; step <= settings->num_steps - 1;
+        step += steps_taken)
+    {
+      update_ghosts(&current_grid);
+
+      /* Write the current grid, and checkpoint it every CHECKPOINT_INTERVAL
+         steps */
+      write_frame(output, &current_grid, step);
+      if(CHECKPOINT_INTERVAL > 0 && step > first_step
+          && step % CHECKPOINT_INTERVAL == 0)
+        write_checkpoint(settings->checkpoint_path, &current_grid, step,
+            &settings->rule);
+
+      /* Either advance a block at a time by up to DEPTH steps (stopping at
+         the next step to write or checkpoint), step only the tiles near last step's
+         changes, or step the whole grid */
+      steps_taken = 1;
+      if(settings->block_size > 0)
+      {
+        steps_taken = steps_until_stop(settings, output, step);
+        step_temporal_blocks(&current_grid, &next_grid, local_grids,
+            settings->block_size, settings->depth, steps_taken,
+            &settings->rule);
+      }
+      else if(settings->tile_size > 0)
+      {
+        find_active_tiles(&tiles);
+        if(output != NULL)
+          fprintf(stderr, "Time Step %d: %d of %d tiles active\n", step,
+              tiles.num_active, tiles.num_tile_rows * tiles.num_tile_cols);
+        step_active_tiles(&current_grid, &next_grid, &tiles,
+            &settings->rule);
+      }
+      else
+        step_grid(&current_grid, &next_grid, &settings->rule);
+
+      /* The next grid becomes the current grid; swapping the buffers avoids
+         copying every cell */
+      temp_grid = current_grid;
+      current_grid = next_grid;
+      next_grid = temp_grid;
+    }
+    end_time = omp_get_wtime();
+
+    /* Checkpoint the final grid */
+    if(settings->checkpoint_path != NULL)
+      write_checkpoint(settings->checkpoint_path, &current_grid, step,
+          &settings->rule);
+
+    if(settings->tile_size > 0)
+      free_tiles(&tiles);
+    if(settings->block_size > 0)
+    {
+      for(thread = 2 * omp_get_max_threads() - 1; thread >= 0; thread--)
+        free_grid(&local_grids[thread]);
+      free(local_grids);
+    }
+  }
+
+  /* Deallocate data structures */
+  free_grid(&next_grid);
+  free_grid(&current_grid);
+
+  return end_time - start_time;
+}
+
+/*******************************************************************************
+ * Print a strong scaling table (same grid, more threads) and a weak scaling
+ *  table (the same number of rows per thread) for thread counts 1, 2, 4, ...
+ *  up to the chosen number of threads
+ ******************************************************************************/
+void print_scaling_tables(struct settings *settings)
+{
+  struct settings scaled = *settings;
+  int NUM_THREADS = settings->num_threads;
+  int threads;
+  double seconds, serial_seconds = 0.0;
+
+  printf("Strong scaling: %d rows x %d columns, %d time steps\n",
+      settings->num_rows, settings->num_cols, settings->num_steps);
+  printf("%8s %12s %10s %10s\n", "Threads", "Seconds", "Speedup",
+      "Efficiency");
+  for(threads = 1; threads <= NUM_THREADS;
+      threads = (threads * 2 > NUM_THREADS && threads < NUM_THREADS)
+      ? NUM_THREADS : threads * 2)
+  {
+    omp_set_num_threads(threads);
+    seconds = run_simulation(settings, NULL);
+    if(threads == 1)
+      serial_seconds = seconds;
+    printf("%8d %12.6f %10.2f %9.1f%%\n", threads, seconds,
+        serial_seconds / seconds, 100.0 * serial_seconds / seconds / threads);
+  }
+
+  printf("\nWeak scaling: %d rows per thread x %d columns, %d time steps\n",
+      settings->num_rows, settings->num_cols, settings->num_steps);
+  printf("%8s %12s %12s %10s\n", "Threads", "Rows", "Seconds", "Efficiency");
+  for(threads = 1; threads <= NUM_THREADS;
+      threads = (threads * 2 > NUM_THREADS && threads < NUM_THREADS)
+      ? NUM_THREADS : threads * 2)
+  {
+    omp_set_num_threads(threads);
+    scaled.num_rows = settings->num_rows * threads;
+    seconds = run_simulation(&scaled, NULL);
+    if(threads == 1)
+      serial_seconds = seconds;
+    printf("%8d %12d %12.6f %9.1f%%\n", threads, scaled.num_rows, seconds,
+        100.0 * serial_seconds / seconds);
+  }
+
+  omp_set_num_threads(NUM_THREADS);
+
+  return;
+}
+
+/****************
+ * Main program *
+ ****************/
+int main(int argc, char **argv)
+{
+  struct settings settings = {
+    5,                     /* num_rows */
+    5,                     /* num_cols */
+    5,                     /* num_steps */
+    ENGINE_SCALAR,         /* engine */
+    -1,                    /* cell_type (chosen from the engine) */
+    omp_get_max_threads(), /* num_threads */
+    0,                     /* log2_step */
+    1024,                  /* node_cache_mb */
+    0,                     /* tile_size */
+    0,                     /* block_size */
+    4,                     /* depth */
+    ISA_AUTO,              /* isa */
+    { 0, 0, { { 0 } }, NULL }, /* rule (parsed below) */
+    NULL,                  /* pattern */
+    NULL,                  /* restart */
+    NULL,                  /* checkpoint_path */
+    0,                     /* checkpoint_interval */
+    NULL,                  /* stream_path */
+    256                    /* band_rows */
+  };
+  char *RULE = NULL, *OUTPUT_PATH = "-", *PATTERN_PATH = NULL;
+  char *RESTART_PATH = NULL, rule_string[32];
+  int OUTPUT_FORMAT = FORMAT_ASCII, OUTPUT_INTERVAL = 1;
+  int SCALING = 0, c, return_value; 
+  unsigned int SEED = time(NULL);
+  struct output output;
+  struct pattern pattern;
+  struct checkpoint restart;
+  struct rule saved_rule;
+
+  /* Parse command line arguments */ 
+  while((c = getopt(argc, argv, "r:c:t:e:y:p:Sg:M:a:B:D:R:k:f:o:i:s:P:w:W:L:m:b:")) != -1)
+  {
+    switch(c)
+    {
+      case 'r':
+        settings.num_rows = atoi(optarg);
+        break;
+      case 'c':
+        settings.num_cols = atoi(optarg);
+        break;
+      case 't':
+        settings.num_steps = atoi(optarg);
+        break;
+      case 'e':
+        if(strcmp(optarg, "scalar") == 0)
+          settings.engine = ENGINE_SCALAR;
+        else if(strcmp(optarg, "bitwise") == 0)
+          settings.engine = ENGINE_BITWISE;
+        else if(strcmp(optarg, "hashlife") == 0)
+          settings.engine = ENGINE_HASHLIFE;
+        else
+        {
+          fprintf(stderr, "ERROR: unknown engine %s; need scalar, bitwise or hashlife\n",
+              optarg);
+          exit(-1);
+        }
+        break;
+      case 'y':
+        if(strcmp(optarg, "uint8") == 0)
+          settings.cell_type = CELL_UINT8;
+        else if(strcmp(optarg, "uint32") == 0)
+          settings.cell_type = CELL_UINT32;
+        else if(strcmp(optarg, "bit") == 0)
+          settings.cell_type = CELL_BIT;
+        else
+        {
+          fprintf(stderr,
+              "ERROR: unknown cell type %s; need uint8, uint32 or bit\n",
+              optarg);
+          exit(-1);
+        }
+        break;
+      case 'p':
+        settings.num_threads = atoi(optarg);
+        break;
+      case 'S':
+        SCALING = 1;
+        break;
+      case 'g':
+        settings.log2_step = atoi(optarg);
+        break;
+      case 'M':
+        settings.node_cache_mb = atoi(optarg);
+        break;
+      case 'a':
+        settings.tile_size = atoi(optarg);
+        break;
+      case 'B':
+        settings.block_size = atoi(optarg);
+        break;
+      case 'D':
+        settings.depth = atoi(optarg);
+        break;
+      case 'R':
+        RULE = optarg;
+        break;
+      case 'f':
+        if(strcmp(optarg, "none") == 0)
+          OUTPUT_FORMAT = FORMAT_NONE;
+        else if(strcmp(optarg, "ascii") == 0)
+          OUTPUT_FORMAT = FORMAT_ASCII;
+        else if(strcmp(optarg, "rle") == 0)
+          OUTPUT_FORMAT = FORMAT_RLE;
+        else if(strcmp(optarg, "binary") == 0)
+          OUTPUT_FORMAT = FORMAT_BINARY;
+        else
+        {
+          fprintf(stderr,
+              "ERROR: unknown format %s; need none, ascii, rle or binary\n",
+              optarg);
+          exit(-1);
+        }
+        break;
+      case 'o':
+        OUTPUT_PATH = optarg;
+        break;
+      case 'i':
+        OUTPUT_INTERVAL = atoi(optarg);
+        break;
+      case 's':
+        SEED = strtoul(optarg, NULL, 0);
+        break;
+      case 'P':
+        PATTERN_PATH = optarg;
+        break;
+      case 'w':
+        settings.checkpoint_path = optarg;
+        break;
+      case 'W':
+        settings.checkpoint_interval = atoi(optarg);
+        break;
+      case 'L':
+        RESTART_PATH = optarg;
+        break;
+      case 'm':
+        settings.stream_path = optarg;
+        break;
+      case 'b':
+        settings.band_rows = atoi(optarg);
+        break;
+      case 'k':
+        if(strcmp(optarg, "auto") == 0)
+          settings.isa = ISA_AUTO;
+        else if(strcmp(optarg, "plain") == 0)
+          settings.isa = ISA_PLAIN;
+        else if(strcmp(optarg, "avx2") == 0)
+          settings.isa = ISA_AVX2;
+        else if(strcmp(optarg, "avx512") == 0)
+          settings.isa = ISA_AVX512;
+        else
+        {
+          fprintf(stderr,
+              "ERROR: unknown kernel %s; need auto, plain, avx2 or avx512\n",
+              optarg);
+          exit(-1);
+        }
+        break;
+      case '?':
+      default:
+        fprintf(stderr, "Usage: %s [-r NUM_ROWS] [-c NUM_COLS] [-t NUM_STEPS] [-e scalar|bitwise|hashlife] [-y uint8|uint32|bit] [-p NUM_THREADS] [-S] [-g LOG2_STEP] [-M NODE_CACHE_MB] [-a TILE_SIZE] [-B BLOCK_SIZE] [-D DEPTH] [-R RULE] [-k auto|plain|avx2|avx512] [-f none|ascii|rle|binary] [-o OUTPUT_PATH] [-i OUTPUT_INTERVAL] [-s SEED] [-P PATTERN_FILE] [-w CHECKPOINT_FILE] [-W CHECKPOINT_INTERVAL] [-L CHECKPOINT_FILE] [-m STREAM_FILE] [-b BAND_ROWS]\n", argv[0]);
+        exit(-1);
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  /* Make sure we have enough rows, columns, time steps, and threads */
+  return_value = assert_minimum_value("row", settings.num_rows, MINIMUM_ROWS);
+  return_value += assert_minimum_value("column", settings.num_cols,
+      MINIMUM_COLUMNS);
+  return_value += assert_minimum_value("time step", settings.num_steps,
+      MINIMUM_TIME_STEPS);
+  return_value += assert_minimum_value("thread", settings.num_threads,
+      MINIMUM_THREADS);
+  return_value += assert_minimum_value("megabyte", settings.node_cache_mb,
+      MINIMUM_NODE_CACHE_MB);
+  return_value += assert_minimum_value("output interval",
+      OUTPUT_INTERVAL, MINIMUM_OUTPUT_INTERVAL);
+
+  /* Start from a checkpoint, which sets the grid size and (unless one is
+   *  given) the rule, or from a pattern, which must fit in the grid */
+  if(RESTART_PATH != NULL)
+  {
+    if(open_checkpoint(RESTART_PATH, &restart) != 0)
+      exit(-1);
+    settings.restart = &restart;
+    settings.num_rows = restart.header->num_rows;
+    settings.num_cols = restart.header->num_cols;
+    saved_rule.birth = restart.header->birth;
+    saved_rule.survival = restart.header->survival;
+    format_rule(&saved_rule, rule_string, sizeof(rule_string));
+    if(RULE == NULL)
+      RULE = rule_string;
+  }
+  else if(PATTERN_PATH != NULL)
+  {
+    if(load_pattern(PATTERN_PATH, &pattern) != 0)
+      exit(-1);
+    settings.pattern = &pattern;
+    if(pattern.num_rows > settings.num_rows
+        || pattern.num_cols > settings.num_cols)
+    {
+      fprintf(stderr, "ERROR: %d x %d pattern does not fit in %d x %d grid\n",
+          pattern.num_rows, pattern.num_cols, settings.num_rows,
+          settings.num_cols);
+      return_value = -1;
+    }
+    if(RULE == NULL && pattern.rule[0] != '\0')
+      RULE = pattern.rule;
+  }
+  if(RULE == NULL)
+    RULE = "B3/S23";
+
+  /* Parse the rule and pick its bit stepper */
+  if(parse_rule(RULE, &settings.rule) != 0
+      || choose_bit_stepper(&settings.rule, settings.isa) != 0)
+    return_value = -1;
+
+  /* Tiles need at least one row and column; 0 turns tracking off */
+  if(settings.tile_size < 0)
+  {
+    fprintf(stderr, "ERROR: tile size %d must be positive, or 0 for none\n",
+        settings.tile_size);
+    return_value = -1;
+  }
+  else if(settings.tile_size > 0 && settings.engine == ENGINE_HASHLIFE)
+  {
+    fprintf(stderr, "ERROR: the hashlife engine does not use tiles\n");
+    return_value = -1;
+  }
+
+  /* Blocks need at least one row and column; 0 turns blocking off. Bit
+   *  grid halos are one word, which covers at most 64 steps. */
+  return_value += assert_minimum_value("blocked step", settings.depth,
+      MINIMUM_DEPTH);
+  if(settings.block_size < 0)
+  {
+    fprintf(stderr, "ERROR: block size %d must be positive, or 0 for none\n",
+        settings.block_size);
+    return_value = -1;
+  }
+  else if(settings.block_size > 0 && (settings.engine == ENGINE_HASHLIFE
+        || settings.tile_size > 0))
+  {
+    fprintf(stderr, "ERROR: blocking does not work with hashlife or tiles\n");
+    return_value = -1;
+  }
+  else if(settings.block_size > 0 && (settings.engine == ENGINE_BITWISE
+        || settings.cell_type == CELL_BIT) && settings.depth > BITS_PER_WORD)
+  {
+    fprintf(stderr, "ERROR: the bitwise engine can block at most %d steps\n",
+        BITS_PER_WORD);
+    return_value = -1;
+  }
+
+  /* Checkpoints hold a grid engine's torus at a time step; HashLife's
+   *  plane and the scaling runs' grids are neither */
+  if(settings.checkpoint_interval < 0)
+  {
+    fprintf(stderr,
+        "ERROR: checkpoint interval %d must be positive, or 0 for the end\n",
+        settings.checkpoint_interval);
+    return_value = -1;
+  }
+  else if(settings.checkpoint_interval > 0 && settings.checkpoint_path == NULL)
+  {
+    fprintf(stderr, "ERROR: a checkpoint interval needs a checkpoint file\n");
+    return_value = -1;
+  }
+  if((settings.checkpoint_path != NULL || RESTART_PATH != NULL)
+      && (settings.engine == ENGINE_HASHLIFE || SCALING))
+  {
+    fprintf(stderr,
+        "ERROR: checkpoints do not work with hashlife or scaling runs\n");
+    return_value = -1;
+  }
+
+  /* Streaming runs take whole rows a band at a time, DEPTH steps at a time,
+   *  on a grid engine */
+  return_value += assert_minimum_value("band row", settings.band_rows,
+      MINIMUM_BAND_ROWS);
+  if(settings.stream_path != NULL && (settings.engine == ENGINE_HASHLIFE
+        || settings.tile_size > 0 || settings.block_size > 0 || SCALING))
+  {
+    fprintf(stderr, "ERROR: streaming does not work with hashlife, tiles, blocking or scaling runs\n");
+    return_value = -1;
+  }
+
+  /* HashLife steps of more than 2^MAXIMUM_LOG2_STEP generations would not
+   *  fit in the universe */
+  if(settings.log2_step < 0 || settings.log2_step > MAXIMUM_LOG2_STEP)
+  {
+    fprintf(stderr, "ERROR: log2 step %d must be from 0 to %d\n",
+        settings.log2_step, MAXIMUM_LOG2_STEP);
+    return_value = -1;
+  }
+
+  /* The bitwise engine needs bit cells, and the scalar engine needs byte or
+   *  word cells (bytes unless told otherwise); the HashLife engine only uses
+   *  the grid for its starting board and display, so it takes any */
+  if(settings.cell_type == -1)
+    settings.cell_type = (settings.engine == ENGINE_BITWISE)
+      ? CELL_BIT : CELL_UINT8;
+  else if(settings.cell_type == CELL_BIT
+      && settings.engine == ENGINE_SCALAR)
+    settings.engine = ENGINE_BITWISE;
+  else if(settings.cell_type != CELL_BIT
+      && settings.engine == ENGINE_BITWISE)
+  {
+    fprintf(stderr, "ERROR: the bitwise engine needs bit cells\n");
+    return_value = -1;
+  }
+
+  /* Exit if we don't */
+  if(return_value != 0)
+  {
+    exit(-1);
+  }
+
+  omp_set_num_threads(settings.num_threads);
+  srandom(SEED);
+
+  /* Either time the engine at increasing thread counts, or run the
+   *  simulation once and write it to the output */
+  if(SCALING)
+    print_scaling_tables(&settings);
+  else
+  {
+    open_output(&output, OUTPUT_FORMAT, OUTPUT_INTERVAL, OUTPUT_PATH,
+        &settings.rule);
+    run_simulation(&settings, &output);
+    close_output(&output);
+  }
+
+  if(settings.restart != NULL)
+    close_checkpoint(settings.restart);
+  if(settings.pattern != NULL)
+    free_pattern(settings.pattern);
 
   return 0;
 }
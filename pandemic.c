@@ -1,13 +1,25 @@
 /* Parallelization: Infectious Disease
  * By Aaron Weeden, Shodor Education Foundation, Inc.
  * November 2011
+ *
+ * Build: gcc -O2 -fopenmp -pthread pandemic.c -o pandemic -lm
+ * With MPI: mpicc -O2 -fopenmp -pthread -D_MPI pandemic.c -o pandemic -lm
  */
 
 #include <assert.h> /* for assert */
+#include <immintrin.h> /* AVX2 and AVX-512 multiplies */
+#include <omp.h> /* OpenMP */
+#include <stdint.h> /* uint32_t, uint64_t */
+#include <math.h> /* sqrt */
 #include <stdio.h> /* printf */
 #include <stdlib.h> /* malloc, free, and various others */
+#include <string.h> /* strcmp, memset */
 #include <time.h> /* time is used to seed the random number generator */
-#include <unistd.h> /* random, getopt, some others */
+#include <unistd.h> /* getopt, fsync, some others */
+#include <pthread.h> /* the checkpoint writer thread */
+#ifdef _MPI
+#include <mpi.h> /* MPI -- build with mpicc -D_MPI */
+#endif
 
 /* States of people -- all people are one of these 4 states */
 /* These are const char because they are displayed as ASCII */
@@ -16,349 +28,2420 @@ const char IMMUNE = 'I';
 const char SUSCEPTIBLE = 'o';
 const char DEAD = ' ';
 
+/* Purposes of random numbers -- each random number is drawn for a purpose,
+ *  a person and a day, so no two draws share a number */
+const uint32_t PLACE_X = 0;
+const uint32_t PLACE_Y = 1;
+const uint32_t MOVE_X = 2;
+const uint32_t MOVE_Y = 3;
+const uint32_t INFECT = 4;
+const uint32_t RECOVER = 5;
+const uint32_t REPLICA_SEED_LOW = 6;
+const uint32_t REPLICA_SEED_HIGH = 7;
+
+/* Coordinates -- 16 bits each, for environments up to 65536 wide and high,
+ *  unless compiled with -DWIDE_COORDINATES */
+#ifdef WIDE_COORDINATES
+typedef int32_t coord_t;
+#define MAX_ENV_SIZE 2147483647
+#else
+typedef uint16_t coord_t;
+#define MAX_ENV_SIZE 65536
+#endif
+
+/* Size of a cache line, which each array of people starts on */
+#define CACHE_LINE_SIZE 64
+
+/* Formats of the statistics file -- comma-separated text with a header line,
+ *  or packed binary: the 8 characters PANDSTAT, a version number and the
+ *  number of fields (as 32-bit integers), then one record of that many
+ *  32-bit integers per day */
+const int STATS_CSV = 0;
+const int STATS_BINARY = 1;
+const uint32_t STATS_VERSION = 1;
+const uint32_t NUM_STATS_FIELDS = 9;
+
+/* Return the random number for a seed, day, person and purpose. This is the
+ *  Philox4x32-10 counter-based generator: rather than stepping one stream of
+ *  numbers that every draw must wait its turn for, it scrambles the counter
+ *  (day, person, purpose) with the key (seed) through 10 rounds of multiplies
+ *  and XORs. Any thread can compute any draw, and the results of a run depend
+ *  only on its seed, however many threads it uses. */
+uint32_t random_number(uint64_t seed, int day, int person, uint32_t purpose)
+{
+  uint32_t counter[4] = { (uint32_t)person, (uint32_t)day, purpose, 0 };
+  uint32_t key[2] = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+  uint64_t product0, product1;
+  int round;
+
+  for(round = 0; round < 10; round++)
+  {
+    product0 = (uint64_t)0xD2511F53 * counter[0];
+    product1 = (uint64_t)0xCD9E8D57 * counter[2];
+    counter[0] = (uint32_t)(product1 >> 32) ^ counter[1] ^ key[0];
+    counter[1] = (uint32_t)product1;
+    counter[2] = (uint32_t)(product0 >> 32) ^ counter[3] ^ key[1];
+    counter[3] = (uint32_t)product0;
+    key[0] += 0x9E3779B9;
+    key[1] += 0xBB67AE85;
+  }
+
+  return counter[0];
+}
+
+/* Kernels for the two inner loops of a day -- moving people and looking for
+ *  infected people nearby -- for each instruction set, chosen with -k (or
+ *  the best one the CPU supports). The vector kernels draw the same random
+ *  numbers and make the same decisions as the plain ones, so the results do
+ *  not depend on which is used. */
+#define ISA_AUTO -1
+#define ISA_PLAIN 0
+#define ISA_AVX2 1
+#define ISA_AVX512 2
+
+/* The most lanes of any kernel; the infected location arrays are padded by
+ *  this many so a kernel can read a whole vector past the end of a span */
+#define MAX_LANES 16
+
+/* Move people begin up to (not including) end one step, each at random:
+ *  left, right or neither and up, down or neither, unless that would leave
+ *  the environment. The dead stay where they are. */
+typedef void (*move_kernel)(coord_t *xs, coord_t *ys, const char *states,
+    const uint32_t *ids, int begin, int end, uint64_t seed, int day,
+    int env_width, int env_height);
+
+/* Return 1 if any of the infected locations begin up to end is within
+ *  radius of x and y, or else 0, and set *checks to how many of them were
+ *  checked before the answer was known */
+typedef int (*nearby_kernel)(const coord_t *infected_xs,
+    const coord_t *infected_ys, int begin, int end, int x, int y, int radius,
+    int *checks);
+
+void move_people(coord_t *xs, coord_t *ys, const char *states,
+    const uint32_t *ids, int begin, int end, uint64_t seed, int day,
+    int env_width, int env_height)
+{
+  int i, x_dir, y_dir;
+
+  for(i = begin; i < end; i++)
+  {
+    /* If the person is not dead, then */
+    if(states[i] != DEAD)
+    {
+      /* Randomly pick whether the person moves left or right or does not move
+       * in the x dimension */
+      x_dir = (random_number(seed, day, ids[i], MOVE_X) % 3) - 1;
+
+      /* Randomly pick whether the person moves up or down or does not move
+       * in the y dimension */
+      y_dir = (random_number(seed, day, ids[i], MOVE_Y) % 3) - 1;
+
+      /* If the person will remain in the bounds of the environment after
+       * moving, then */
+      if((xs[i] + x_dir >= 0) &&
+         (xs[i] + x_dir < env_width) &&
+         (ys[i] + y_dir >= 0) &&
+         (ys[i] + y_dir < env_height))
+      {
+        /* Move the person */
+        xs[i] += x_dir;
+        ys[i] += y_dir;
+      }
+    }
+  }
+
+  return;
+}
+
+int any_nearby(const coord_t *infected_xs, const coord_t *infected_ys,
+    int begin, int end, int x, int y, int radius, int *checks)
+{
+  int i;
+
+  for(i = begin; i < end; i++)
+  {
+    /* If the location is within the infection radius, then */
+    if((x >= infected_xs[i] - radius) &&
+       (x <= infected_xs[i] + radius) &&
+       (y >= infected_ys[i] - radius) &&
+       (y <= infected_ys[i] + radius))
+    {
+      *checks = i + 1 - begin;
+      return 1;
+    }
+  }
+
+  *checks = end - begin;
+  return 0;
+}
+
+/* Vectors of 8 and 16 lanes */
+typedef uint32_t uints_x8 __attribute__((vector_size(32)));
+typedef int32_t ints_x8 __attribute__((vector_size(32)));
+typedef coord_t coords_x8 __attribute__((vector_size(8 * sizeof(coord_t))));
+typedef char chars_x8 __attribute__((vector_size(8)));
+typedef uint32_t uints_x16 __attribute__((vector_size(64)));
+typedef int32_t ints_x16 __attribute__((vector_size(64)));
+typedef coord_t coords_x16 __attribute__((vector_size(16 * sizeof(coord_t))));
+typedef char chars_x16 __attribute__((vector_size(16)));
+
+/* Multiply each lane of a by the same lane of b, and return the low 32 bits
+ *  of the products and set *high to the high 32 bits. The instruction
+ *  multiplies only the even lanes, so the odd lanes are shifted down into
+ *  them and multiplied separately, then the halves are blended back. */
+__attribute__((target("avx2")))
+static inline uints_x8 multiply_avx2(uints_x8 a, uints_x8 b, uints_x8 *high)
+{
+  __m256i even = _mm256_mul_epu32((__m256i)a, (__m256i)b);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64((__m256i)a, 32),
+      _mm256_srli_epi64((__m256i)b, 32));
+
+  *high = (uints_x8)_mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd,
+      0xAA);
+  return (uints_x8)_mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+__attribute__((target("avx512f")))
+static inline uints_x16 multiply_avx512(uints_x16 a, uints_x16 b,
+    uints_x16 *high)
+{
+  __m512i even = _mm512_mul_epu32((__m512i)a, (__m512i)b);
+  __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64((__m512i)a, 32),
+      _mm512_srli_epi64((__m512i)b, 32));
+
+  *high = (uints_x16)_mm512_mask_blend_epi32(0xAAAA,
+      _mm512_srli_epi64(even, 32), odd);
+  return (uints_x16)_mm512_mask_blend_epi32(0xAAAA, even,
+      _mm512_slli_epi64(odd, 32));
+}
+
+/* Define a function returning the random numbers of a vector of people for
+ *  a seed, day and purpose -- random_number a lane at a time */
+#define DEFINE_RANDOM_NUMBERS(name, uints_t, multiply, target) \
+target static inline uints_t name(uint64_t seed, int day, uints_t people, \
+    uint32_t purpose) \
+{ \
+  uints_t counter0 = people, counter1, counter2, counter3; \
+  uints_t multiplier0 = people * 0 + 0xD2511F53; \
+  uints_t multiplier1 = people * 0 + 0xCD9E8D57; \
+  uints_t high0, high1, low0, low1; \
+  uint32_t key0 = (uint32_t)seed, key1 = (uint32_t)(seed >> 32); \
+  int round; \
+  \
+  counter1 = people * 0 + (uint32_t)day; \
+  counter2 = people * 0 + purpose; \
+  counter3 = people * 0; \
+  for(round = 0; round < 10; round++) \
+  { \
+    low0 = multiply(counter0, multiplier0, &high0); \
+    low1 = multiply(counter2, multiplier1, &high1); \
+    counter0 = high1 ^ counter1 ^ key0; \
+    counter1 = low1; \
+    counter2 = high0 ^ counter3 ^ key1; \
+    counter3 = low0; \
+    key0 += 0x9E3779B9; \
+    key1 += 0xBB67AE85; \
+  } \
+  \
+  return counter0; \
+}
+
+/* Define a move_kernel a vector of people at a time: the steps are the
+ *  random numbers modulo 3 (dividing by multiplying by 2^33 / 3), less 1, and
+ *  each person's steps are masked off, rather than branched around, if they
+ *  are dead or would leave the environment. People left over after the last
+ *  whole vector are moved by move_people. */
+#define DEFINE_MOVE_KERNEL(name, random_numbers, multiply, uints_t, ints_t, \
+    coords_t, chars_t, target) \
+target void name(coord_t *xs, coord_t *ys, const char *states, \
+    const uint32_t *ids, int begin, int end, uint64_t seed, int day, \
+    int env_width, int env_height) \
+{ \
+  int lanes = sizeof(uints_t) / sizeof(uint32_t); \
+  int i; \
+  uints_t people, x_random, y_random, x_third, y_third; \
+  uints_t one_third = people * 0 + 0xAAAAAAAB; \
+  ints_t x, y, x_dir, y_dir, moves; \
+  coords_t coords; \
+  chars_t lane_states; \
+  \
+  for(i = begin; i + lanes <= end; i += lanes) \
+  { \
+    memcpy(&people, &ids[i], sizeof(people)); \
+    x_random = random_numbers(seed, day, people, MOVE_X); \
+    y_random = random_numbers(seed, day, people, MOVE_Y); \
+    multiply(x_random, one_third, &x_third); \
+    multiply(y_random, one_third, &y_third); \
+    x_dir = (ints_t)(x_random - (x_third >> 1) * 3) - 1; \
+    y_dir = (ints_t)(y_random - (y_third >> 1) * 3) - 1; \
+    \
+    memcpy(&coords, &xs[i], sizeof(coords)); \
+    x = __builtin_convertvector(coords, ints_t); \
+    memcpy(&coords, &ys[i], sizeof(coords)); \
+    y = __builtin_convertvector(coords, ints_t); \
+    memcpy(&lane_states, &states[i], sizeof(lane_states)); \
+    \
+    moves = __builtin_convertvector(lane_states != DEAD, ints_t) \
+      & (x + x_dir >= 0) & (x + x_dir < env_width) \
+      & (y + y_dir >= 0) & (y + y_dir < env_height); \
+    x += x_dir & moves; \
+    y += y_dir & moves; \
+    \
+    coords = __builtin_convertvector(x, coords_t); \
+    memcpy(&xs[i], &coords, sizeof(coords)); \
+    coords = __builtin_convertvector(y, coords_t); \
+    memcpy(&ys[i], &coords, sizeof(coords)); \
+  } \
+  \
+  move_people(xs, ys, states, ids, i, end, seed, day, env_width, env_height); \
+}
+
+/* Define a nearby_kernel a vector of locations at a time, masking off the
+ *  lanes past the end of the span; every location in a vector is checked,
+ *  so *checks counts whole vectors up to the end of the span */
+#define DEFINE_NEARBY_KERNEL(name, ints_t, coords_t, target) \
+target int name(const coord_t *infected_xs, const coord_t *infected_ys, \
+    int begin, int end, int x, int y, int radius, int *checks) \
+{ \
+  int lanes = sizeof(ints_t) / sizeof(int32_t); \
+  int i, lane; \
+  ints_t lane_numbers, infected_x, infected_y, near; \
+  coords_t coords; \
+  \
+  for(lane = 0; lane < lanes; lane++) \
+  { \
+    lane_numbers[lane] = lane; \
+  } \
+  \
+  for(i = begin; i < end; i += lanes) \
+  { \
+    memcpy(&coords, &infected_xs[i], sizeof(coords)); \
+    infected_x = __builtin_convertvector(coords, ints_t); \
+    memcpy(&coords, &infected_ys[i], sizeof(coords)); \
+    infected_y = __builtin_convertvector(coords, ints_t); \
+    \
+    near = (lane_numbers < end - i) \
+      & (infected_x >= x - radius) & (infected_x <= x + radius) \
+      & (infected_y >= y - radius) & (infected_y <= y + radius); \
+    for(lane = 0; lane < lanes; lane++) \
+    { \
+      if(near[lane]) \
+      { \
+        *checks = ((i + lanes < end) ? i + lanes : end) - begin; \
+        return 1; \
+      } \
+    } \
+  } \
+  \
+  *checks = end - begin; \
+  return 0; \
+}
+
+DEFINE_RANDOM_NUMBERS(random_numbers_avx2, uints_x8, multiply_avx2,
+    __attribute__((target("avx2"))))
+DEFINE_RANDOM_NUMBERS(random_numbers_avx512, uints_x16, multiply_avx512,
+    __attribute__((target("avx512f"))))
+DEFINE_MOVE_KERNEL(move_people_avx2, random_numbers_avx2, multiply_avx2,
+    uints_x8, ints_x8, coords_x8, chars_x8, __attribute__((target("avx2"))))
+DEFINE_MOVE_KERNEL(move_people_avx512, random_numbers_avx512, multiply_avx512,
+    uints_x16, ints_x16, coords_x16, chars_x16,
+    __attribute__((target("avx512f"))))
+DEFINE_NEARBY_KERNEL(any_nearby_avx2, ints_x8, coords_x8,
+    __attribute__((target("avx2"))))
+DEFINE_NEARBY_KERNEL(any_nearby_avx512, ints_x16, coords_x16,
+    __attribute__((target("avx512f"))))
+
+const move_kernel MOVE_KERNELS[3] = { move_people, move_people_avx2,
+  move_people_avx512 };
+const nearby_kernel NEARBY_KERNELS[3] = { any_nearby, any_nearby_avx2,
+  any_nearby_avx512 };
+
+/* Choose the instruction set for the kernels: the given one, or the best one
+ *  this CPU supports. Return it, or print an error and return -1 if the CPU
+ *  does not support the given one. */
+int choose_isa(int isa)
+{
+  __builtin_cpu_init();
+  if(isa == ISA_AUTO)
+  {
+    if(__builtin_cpu_supports("avx512f"))
+    {
+      isa = ISA_AVX512;
+    }
+    else if(__builtin_cpu_supports("avx2"))
+    {
+      isa = ISA_AVX2;
+    }
+    else
+    {
+      isa = ISA_PLAIN;
+    }
+  }
+  else if((isa == ISA_AVX512 && !__builtin_cpu_supports("avx512f"))
+      || (isa == ISA_AVX2 && !__builtin_cpu_supports("avx2")))
+  {
+    fprintf(stderr, "ERROR: this CPU does not support the chosen kernel\n");
+    return -1;
+  }
+
+  return isa;
+}
+
+/* The parameters of a simulation */
+struct parameters
+{
+  /* People */
+  int num_people;
+  int num_init_infected;
+
+  /* Environment */
+  int env_width;
+  int env_height;
+
+  /* Disease */
+  int infection_radius;
+  int disease_duration;
+  int contagiousness_factor;
+  int deadliness_factor;
+
+  /* Time */
+  int num_days;
+  int microseconds_per_day;
+
+  /* People are sorted by the cell they are in every reorder_interval days
+   *  (0 for never), so people near each other are near each other in
+   *  memory */
+  int reorder_interval;
+
+  /* Random numbers */
+  uint64_t seed;
+
+  /* Instruction set of the kernels */
+  int isa;
+
+  /* Subdomain -- this process (rank) of num_ranks simulates the people in
+   *  rows row_begin up to (not including) row_end of the environment; with
+   *  one process, that is all of it */
+  int rank;
+  int num_ranks;
+  int row_begin;
+  int row_end;
+
+  /* Output -- a frame of the environment is displayed every frame_interval
+   *  days (0 for none), and the day's counts are written to the statistics
+   *  file (if any) every day */
+  int frame_interval;
+  FILE *stats_file;
+  int stats_format;
+
+  /* Where the time goes (NULL if it is not being measured) */
+  struct profile *profile;
+
+  /* Checkpoints -- the state is written to checkpoint_path (if not NULL)
+   *  every checkpoint_interval days, and the run restarted from the
+   *  checkpoint at restart_path (if not NULL) */
+  char *checkpoint_path;
+  int checkpoint_interval;
+  char *restart_path;
+};
+
+/* The counts of a simulation */
+struct counts
+{
+  int num_susceptible;
+  int num_infected;
+  int num_immune;
+  int num_dead;
+  double num_infections;
+  double infection_attempts;
+  double num_deaths;
+  double recovery_attempts;
+};
+
+/* Phases of a day, which are timed separately when profiling */
+#define PHASE_REORDER 0
+#define PHASE_EXCHANGE 1
+#define PHASE_INDEX 2
+#define PHASE_DISPLAY 3
+#define PHASE_MOVEMENT 4
+#define PHASE_INFECTION 5
+#define PHASE_RECOVERY 6
+#define PHASE_MIGRATION 7
+#define PHASE_OUTPUT 8
+#define PHASE_CHECKPOINT 9
+#define NUM_PHASES 10
+
+const char *PHASE_NAMES[NUM_PHASES] = { "reorder", "exchange", "index",
+  "display", "movement", "infection", "recovery", "migration", "output",
+  "checkpoint" };
+
+/* The time spent in each phase of each day, in seconds at
+ *  seconds[day * NUM_PHASES + phase], and counters of the work done */
+struct profile
+{
+  int num_days;
+  double *seconds;
+  double total_seconds;
+
+  /* Susceptible people searched for infected people nearby, and infected
+   *  locations the nearby kernel checked in the spans they searched (which
+   *  the vector kernels check a whole vector at a time) */
+  double susceptible_searches;
+  double pair_checks;
+};
+
+/* Add the time since *start to a phase of a day, and restart *start; this
+ *  does nothing if the profile is NULL, so it costs next to nothing when not
+ *  profiling */
+void time_phase(struct profile *profile, int day, int phase, double *start)
+{
+  double now;
+
+  if(profile == NULL)
+  {
+    return;
+  }
+
+  now = omp_get_wtime();
+  profile->seconds[day * NUM_PHASES + phase] += now - *start;
+  *start = now;
+
+  return;
+}
+
+/* Write a profile and the final counts of a run, as JSON. With more than one
+ *  process, each phase's time is the most any process took. */
+void write_profile(FILE *file, struct parameters *parameters,
+    struct profile *profile, struct counts *counts)
+{
+  double total, slowest;
+  int day, phase;
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"people\": %d,\n", parameters->num_people);
+  fprintf(file, "  \"environment\": [%d, %d],\n", parameters->env_width,
+      parameters->env_height);
+  fprintf(file, "  \"days\": %d,\n", profile->num_days);
+  fprintf(file, "  \"threads\": %d,\n", omp_get_max_threads());
+  fprintf(file, "  \"processes\": %d,\n", parameters->num_ranks);
+  fprintf(file, "  \"kernel\": \"%s\",\n", (parameters->isa == ISA_AVX512)
+      ? "avx512" : (parameters->isa == ISA_AVX2) ? "avx2" : "plain");
+  fprintf(file, "  \"seed\": %llu,\n", (unsigned long long)parameters->seed);
+  fprintf(file, "  \"total_seconds\": %.9f,\n", profile->total_seconds);
+  fprintf(file, "  \"phases\": {\n");
+  for(phase = 0; phase < NUM_PHASES; phase++)
+  {
+    total = slowest = 0.0;
+    for(day = 0; day < profile->num_days; day++)
+    {
+      total += profile->seconds[day * NUM_PHASES + phase];
+      if(profile->seconds[day * NUM_PHASES + phase] > slowest)
+      {
+        slowest = profile->seconds[day * NUM_PHASES + phase];
+      }
+    }
+    fprintf(file, "    \"%s\": {\"seconds\": %.9f, \"fraction\": %.6f, \"max_day_seconds\": %.9f, \"per_day\": [", PHASE_NAMES[phase], total, (profile->total_seconds > 0.0) ? total / profile->total_seconds : 0.0, slowest);
+    for(day = 0; day < profile->num_days; day++)
+    {
+      fprintf(file, "%s%.9f", (day > 0) ? ", " : "",
+          profile->seconds[day * NUM_PHASES + phase]);
+    }
+    fprintf(file, "]}%s\n", (phase < NUM_PHASES - 1) ? "," : "");
+  }
+  fprintf(file, "  },\n");
+  fprintf(file, "  \"counters\": {\n");
+  fprintf(file, "    \"person_days\": %.0f,\n",
+      (double)parameters->num_people * profile->num_days);
+  fprintf(file, "    \"susceptible_searches\": %.0f,\n",
+      profile->susceptible_searches);
+  fprintf(file, "    \"pair_checks\": %.0f,\n", profile->pair_checks);
+  fprintf(file, "    \"infection_attempts\": %.0f,\n",
+      counts->infection_attempts);
+  fprintf(file, "    \"infections\": %.0f,\n", counts->num_infections);
+  fprintf(file, "    \"infections_per_pair_check\": %.9f,\n",
+      (profile->pair_checks > 0.0)
+      ? counts->num_infections / profile->pair_checks : 0.0);
+  fprintf(file, "    \"recovery_attempts\": %.0f,\n",
+      counts->recovery_attempts);
+  fprintf(file, "    \"deaths\": %.0f,\n", counts->num_deaths);
+  fprintf(file, "    \"person_days_per_second\": %.1f\n",
+      (profile->total_seconds > 0.0) ? (double)parameters->num_people
+      * profile->num_days / profile->total_seconds : 0.0);
+  fprintf(file, "  },\n");
+  fprintf(file, "  \"final_counts\": {\"susceptible\": %d, \"infected\": %d, \"immune\": %d, \"dead\": %d}\n", counts->num_susceptible, counts->num_infected, counts->num_immune, counts->num_dead);
+  fprintf(file, "}\n");
+
+  return;
+}
+
+/* The arrays of a simulation -- allocated once, for up to max_people people,
+ *  max_cells cells of the spatial index and max_days days, as one block
+ *  (the arena) with each array starting on a cache line, and reused from run
+ *  to run. A person is the same index in xs, ys, states and ids; reordering
+ *  moves people to other indexes, but ids keeps the number each person's
+ *  random numbers are drawn for, so it does not change the results. */
+struct population
+{
+  int max_people;
+  int max_cells;
+  int max_days;
+  char *arena;
+
+  /* Locations, states and numbers of people */
+  coord_t *xs;
+  coord_t *ys;
+  char *states;
+  uint32_t *ids;
+
+  /* The infected people, in the order they were infected: everyone infected
+   *  on a day recovers disease_duration days later, so the people who
+   *  recover on a day are always at the front. Those infected up to the end
+   *  of day d are before cohort_ends[d]. */
+  int *infected;
+  int *cohort_ends;
+
+  /* The infected x and y locations sorted by cell: the ones in cell number
+   *  (cell_y * index_width + cell_x) are from cell_starts[cell] up to
+   *  cell_starts[cell + 1] */
+  int *cell_starts;
+  coord_t *cell_infected_xs;
+  coord_t *cell_infected_ys;
+
+  /* Infected x and y locations, in pairs, from the neighboring subdomains
+   *  (with more than one process) */
+  int max_ghosts;
+  coord_t *ghosts;
+
+  /* Array of character arrays, a.k.a. array of character pointers, for text
+   *  display (NULL if there is no display) */
+  char **environment;
+  int env_height;
+};
+
+/* Return the next array of size bytes from the arena, starting at *offset
+ *  (or just work out the offsets if the arena is NULL), and move *offset to
+ *  the next cache line after it */
+void *take_from_arena(char *arena, size_t *offset, size_t size)
+{
+  void *array = (arena == NULL) ? NULL : arena + *offset;
+
+  *offset += (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+  return array;
+}
+
+/* Allocate the arrays for up to max_people people and max_ghosts infected
+ *  people from neighboring subdomains in an environment of env_width by
+ *  env_height for up to max_days days, with an infection radius of at least
+ *  min_infection_radius, and for a display if there is one */
+void alloc_population(struct population *population, int max_people,
+    int max_ghosts, int env_width, int env_height, int max_days,
+    int min_infection_radius, int display)
+{
+  int cell_size = (min_infection_radius > 1) ? min_infection_radius : 1;
+  int y, pass;
+  size_t offset = 0;
+
+  population->max_people = max_people;
+  population->max_ghosts = max_ghosts;
+  population->max_days = max_days;
+  population->max_cells = ((env_width + cell_size - 1) / cell_size)
+    * ((env_height + cell_size - 1) / cell_size);
+  population->env_height = env_height;
+  population->arena = NULL;
+
+  /* Work out how big the arena is, then allocate it and hand out the
+   *  arrays */
+  for(pass = 0; pass < 2; pass++)
+  {
+    if(pass == 1)
+    {
+      if(posix_memalign((void**)&population->arena, CACHE_LINE_SIZE, offset)
+          != 0)
+      {
+        fprintf(stderr, "ERROR: cannot allocate %zu bytes for %d people\n", offset, max_people);
+        exit(-1);
+      }
+      offset = 0;
+    }
+
+    population->xs = (coord_t*)take_from_arena(population->arena, &offset,
+        (size_t)max_people * sizeof(coord_t));
+    population->ys = (coord_t*)take_from_arena(population->arena, &offset,
+        (size_t)max_people * sizeof(coord_t));
+    population->states = (char*)take_from_arena(population->arena, &offset,
+        (size_t)max_people * sizeof(char));
+    population->ids = (uint32_t*)take_from_arena(population->arena, &offset,
+        (size_t)max_people * sizeof(uint32_t));
+    population->infected = (int*)take_from_arena(population->arena, &offset,
+        (size_t)max_people * sizeof(int));
+    population->cohort_ends = (int*)take_from_arena(population->arena,
+        &offset, (size_t)max_days * sizeof(int));
+    population->cell_starts = (int*)take_from_arena(population->arena,
+        &offset, (size_t)(population->max_cells + 1) * sizeof(int));
+    population->cell_infected_xs = (coord_t*)take_from_arena(
+        population->arena, &offset, (size_t)(max_people + max_ghosts
+          + MAX_LANES) * sizeof(coord_t));
+    population->cell_infected_ys = (coord_t*)take_from_arena(
+        population->arena, &offset, (size_t)(max_people + max_ghosts
+          + MAX_LANES) * sizeof(coord_t));
+    population->ghosts = (coord_t*)take_from_arena(population->arena,
+        &offset, (size_t)max_ghosts * 2 * sizeof(coord_t));
+
+    /* The display is a row pointer and a row of characters per line */
+    population->environment = NULL;
+    if(display)
+    {
+      population->environment = (char**)take_from_arena(population->arena,
+          &offset, (size_t)env_height * sizeof(char*));
+      for(y = 0; y < env_height; y++)
+      {
+        if(population->arena != NULL)
+        {
+          population->environment[y] = (char*)take_from_arena(
+              population->arena, &offset, env_width * sizeof(char));
+        }
+        else
+        {
+          take_from_arena(NULL, &offset, env_width * sizeof(char));
+        }
+      }
+    }
+  }
+
+  return;
+}
+
+/* Deallocate the arrays -- we have finished using the memory, so now we
+ *  "free" it back to the heap */
+void free_population(struct population *population)
+{
+  free(population->arena);
+
+  return;
+}
+
+/* Sort people by the cell of the spatial index they are in (cells of
+ *  cell_size, index_width across, from row row_origin down), moving
+ *  everything stored by person -- including the infected people's numbers --
+ *  along with them */
+void reorder_population(struct population *population, int num_people,
+    int cell_size, int index_width, int row_origin, int num_cells,
+    int first_infected, int end_infected)
+{
+  coord_t *xs = population->xs;
+  coord_t *ys = population->ys;
+  char *states = population->states;
+  uint32_t *ids = population->ids;
+  int *cell_starts = population->cell_starts;
+  int *new_indexes, cell, i, j, temp;
+  coord_t temp_coord;
+  char temp_state;
+  uint32_t temp_id;
+
+  new_indexes = (int*)malloc((size_t)num_people * sizeof(int));
+
+  /* Count the people in each cell, turn the counts into starting indexes,
+   *  then give each person the next index in their cell */
+  for(cell = 0; cell <= num_cells; cell++)
+  {
+    cell_starts[cell] = 0;
+  }
+  for(i = 0; i < num_people; i++)
+  {
+    cell_starts[((ys[i] - row_origin) / cell_size) * index_width
+      + xs[i] / cell_size + 1]++;
+  }
+  for(cell = 0; cell < num_cells; cell++)
+  {
+    cell_starts[cell + 1] += cell_starts[cell];
+  }
+  for(i = 0; i < num_people; i++)
+  {
+    new_indexes[i] = cell_starts[((ys[i] - row_origin) / cell_size)
+      * index_width + xs[i] / cell_size]++;
+  }
+
+  /* Renumber the infected people */
+  for(i = first_infected; i < end_infected; i++)
+  {
+    population->infected[i] = new_indexes[population->infected[i]];
+  }
+
+  /* Move each person to their new index, swapping whoever is there into
+   *  this one until this one's person belongs here */
+  for(i = 0; i < num_people; i++)
+  {
+    while(new_indexes[i] != i)
+    {
+      j = new_indexes[i];
+      temp_coord = xs[i]; xs[i] = xs[j]; xs[j] = temp_coord;
+      temp_coord = ys[i]; ys[i] = ys[j]; ys[j] = temp_coord;
+      temp_state = states[i]; states[i] = states[j]; states[j] = temp_state;
+      temp_id = ids[i]; ids[i] = ids[j]; ids[j] = temp_id;
+      temp = new_indexes[i]; new_indexes[i] = new_indexes[j];
+      new_indexes[j] = temp;
+    }
+  }
+
+  free(new_indexes);
+
+  return;
+}
+
+#ifdef _MPI
+/* Place the people whose random starting location is in this process's
+ *  rows -- every process draws every person's row, and keeps its own -- and
+ *  add the initially infected ones to the infected people. Return the number
+ *  of people placed. */
+int place_subdomain_people(struct parameters *parameters,
+    struct population *population, int *end_infected)
+{
+  uint64_t seed = parameters->seed;
+  int num_people = 0;
+  int id, y;
+
+  for(id = 0; id < parameters->num_people; id++)
+  {
+    y = random_number(seed, 0, id, PLACE_Y) % parameters->env_height;
+    if(y < parameters->row_begin || y >= parameters->row_end)
+    {
+      continue;
+    }
+
+    if(num_people == population->max_people)
+    {
+      fprintf(stderr, "ERROR: more than %d people start in the rows of process %d\n", population->max_people, parameters->rank);
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    population->ids[num_people] = id;
+    population->xs[num_people] = random_number(seed, 0, id, PLACE_X)
+      % parameters->env_width;
+    population->ys[num_people] = y;
+    if(id < parameters->num_init_infected)
+    {
+      population->states[num_people] = INFECTED;
+      population->infected[(*end_infected)++] = num_people;
+    }
+    else
+    {
+      population->states[num_people] = SUSCEPTIBLE;
+    }
+    num_people++;
+  }
+
+  return num_people;
+}
+
+/* Send the neighboring processes the locations of the infected people
+ *  within ghost_rows of the edges of this process's rows, and receive theirs
+ *  into population->ghosts. Return the number received. */
+int exchange_ghosts(struct parameters *parameters,
+    struct population *population, int ghost_rows, int first_infected,
+    int end_infected)
+{
+  int lower = (parameters->rank > 0) ? parameters->rank - 1 : MPI_PROC_NULL;
+  int upper = (parameters->rank < parameters->num_ranks - 1)
+    ? parameters->rank + 1 : MPI_PROC_NULL;
+  int num_down = 0, num_up = 0, num_from_lower = 0, num_from_upper = 0;
+  int i, person;
+  coord_t *down, *up;
+
+  down = (coord_t*)malloc((size_t)(end_infected - first_infected) * 2
+      * sizeof(coord_t));
+  up = (coord_t*)malloc((size_t)(end_infected - first_infected) * 2
+      * sizeof(coord_t));
+  for(i = first_infected; i < end_infected; i++)
+  {
+    person = population->infected[i];
+    if(population->ys[person] < parameters->row_begin + ghost_rows)
+    {
+      down[2 * num_down] = population->xs[person];
+      down[2 * num_down + 1] = population->ys[person];
+      num_down++;
+    }
+    if(population->ys[person] >= parameters->row_end - ghost_rows)
+    {
+      up[2 * num_up] = population->xs[person];
+      up[2 * num_up + 1] = population->ys[person];
+      num_up++;
+    }
+  }
+
+  MPI_Sendrecv(&num_down, 1, MPI_INT, lower, 0, &num_from_upper, 1, MPI_INT,
+      upper, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(&num_up, 1, MPI_INT, upper, 1, &num_from_lower, 1, MPI_INT,
+      lower, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  if(num_from_upper + num_from_lower > population->max_ghosts)
+  {
+    fprintf(stderr, "ERROR: more than %d infected people near the rows of process %d\n", population->max_ghosts, parameters->rank);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+
+  MPI_Sendrecv(down, num_down * 2 * sizeof(coord_t), MPI_BYTE, lower, 2,
+      population->ghosts, num_from_upper * 2 * sizeof(coord_t), MPI_BYTE,
+      upper, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(up, num_up * 2 * sizeof(coord_t), MPI_BYTE, upper, 3,
+      population->ghosts + 2 * num_from_upper,
+      num_from_lower * 2 * sizeof(coord_t), MPI_BYTE, lower, 3,
+      MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+  free(up);
+  free(down);
+
+  return num_from_upper + num_from_lower;
+}
+
+/* Number of integers sent per person who moves to another subdomain: id, x,
+ *  y, state, and the day they were infected (or -1) */
+#define MIGRANT_SIZE 5
+
+/* Send the people who have moved out of this process's rows -- one row at
+ *  most, so into a neighbor's -- to that neighbor, and take in the people who
+ *  have moved in. The infected people are then put back in order of the day
+ *  they were infected, from the front of population->infected, with the
+ *  days' ends in population->cohort_ends. first_infected_day is the first day
+ *  whose infected people have not yet recovered. Return the new number of
+ *  people, and set *end_infected. */
+int migrate_people(struct parameters *parameters,
+    struct population *population, int num_people, int first_infected,
+    int *end_infected, int first_infected_day, int current_day)
+{
+  int lower = (parameters->rank > 0) ? parameters->rank - 1 : MPI_PROC_NULL;
+  int upper = (parameters->rank < parameters->num_ranks - 1)
+    ? parameters->rank + 1 : MPI_PROC_NULL;
+  coord_t *xs = population->xs;
+  coord_t *ys = population->ys;
+  char *states = population->states;
+  uint32_t *ids = population->ids;
+  int *infected = population->infected;
+  int *cohort_ends = population->cohort_ends;
+  int num_down = 0, num_up = 0, num_from_lower = 0, num_from_upper = 0;
+  int *days, *down, *up, *migrant, *from_upper, *from_lower;
+  int i, k, day, num_kept = 0;
+
+  /* Find the day each infected person was infected */
+  days = (int*)malloc((size_t)population->max_people * sizeof(int));
+  for(i = 0; i < num_people; i++)
+  {
+    days[i] = -1;
+  }
+  day = first_infected_day;
+  for(k = first_infected; k < *end_infected; k++)
+  {
+    while(k >= cohort_ends[day])
+    {
+      day++;
+    }
+    days[infected[k]] = day;
+  }
+
+  /* Pack up the people who have left, and move the rest to the front */
+  down = (int*)malloc((size_t)num_people * MIGRANT_SIZE * sizeof(int));
+  up = (int*)malloc((size_t)num_people * MIGRANT_SIZE * sizeof(int));
+  for(i = 0; i < num_people; i++)
+  {
+    if(ys[i] >= parameters->row_begin && ys[i] < parameters->row_end)
+    {
+      xs[num_kept] = xs[i];
+      ys[num_kept] = ys[i];
+      states[num_kept] = states[i];
+      ids[num_kept] = ids[i];
+      days[num_kept] = days[i];
+      num_kept++;
+      continue;
+    }
+
+    migrant = (ys[i] < parameters->row_begin)
+      ? &down[MIGRANT_SIZE * num_down++] : &up[MIGRANT_SIZE * num_up++];
+    migrant[0] = ids[i];
+    migrant[1] = xs[i];
+    migrant[2] = ys[i];
+    migrant[3] = states[i];
+    migrant[4] = days[i];
+  }
+
+  /* Trade people with the neighbors */
+  MPI_Sendrecv(&num_down, 1, MPI_INT, lower, 4, &num_from_upper, 1, MPI_INT,
+      upper, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(&num_up, 1, MPI_INT, upper, 5, &num_from_lower, 1, MPI_INT,
+      lower, 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  if(num_kept + num_from_upper + num_from_lower > population->max_people)
+  {
+    fprintf(stderr, "ERROR: more than %d people in the rows of process %d\n", population->max_people, parameters->rank);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  from_upper = (int*)malloc(((size_t)num_from_upper + num_from_lower)
+      * MIGRANT_SIZE * sizeof(int));
+  from_lower = from_upper + MIGRANT_SIZE * num_from_upper;
+  MPI_Sendrecv(down, num_down * MIGRANT_SIZE, MPI_INT, lower, 6, from_upper,
+      num_from_upper * MIGRANT_SIZE, MPI_INT, upper, 6, MPI_COMM_WORLD,
+      MPI_STATUS_IGNORE);
+  MPI_Sendrecv(up, num_up * MIGRANT_SIZE, MPI_INT, upper, 7, from_lower,
+      num_from_lower * MIGRANT_SIZE, MPI_INT, lower, 7, MPI_COMM_WORLD,
+      MPI_STATUS_IGNORE);
+
+  /* Unpack the people who have arrived after the rest */
+  num_people = num_kept;
+  for(i = 0; i < num_from_upper + num_from_lower; i++)
+  {
+    migrant = &from_upper[MIGRANT_SIZE * i];
+    ids[num_people] = migrant[0];
+    xs[num_people] = migrant[1];
+    ys[num_people] = migrant[2];
+    states[num_people] = migrant[3];
+    days[num_people] = migrant[4];
+    num_people++;
+  }
+
+  /* Sort the infected people by day: count each day's, turn the counts
+   *  into starting positions, then place each person at their day's next
+   *  position, which leaves each day's position at its end */
+  for(day = first_infected_day; day <= current_day; day++)
+  {
+    cohort_ends[day] = 0;
+  }
+  for(i = 0; i < num_people; i++)
+  {
+    if(days[i] >= 0)
+    {
+      cohort_ends[days[i]]++;
+    }
+  }
+  *end_infected = 0;
+  for(day = first_infected_day; day <= current_day; day++)
+  {
+    k = cohort_ends[day];
+    cohort_ends[day] = *end_infected;
+    *end_infected += k;
+  }
+  for(i = 0; i < num_people; i++)
+  {
+    if(days[i] >= 0)
+    {
+      infected[cohort_ends[days[i]]++] = i;
+    }
+  }
+
+  free(from_upper);
+  free(up);
+  free(down);
+  free(days);
+
+  return num_people;
+}
+#endif
+
+/* Checkpoints -- the state of a run at the end of a day, to restart it from.
+ *  A checkpoint file is a header, then this process's people's x and y
+ *  locations, states and numbers, the infected people (in the order they
+ *  were infected, numbered from the front), and the ends of each day's
+ *  infected people since the first day whose infected people have not
+ *  recovered. The random numbers depend only on the seed, day and person,
+ *  so a restarted run carries on exactly as the original would have. With
+ *  more than one process, each writes its own file, named with its rank. */
+#define CHECKPOINT_MAGIC "PANDCKPT"
+#define CHECKPOINT_VERSION 1
+
+struct checkpoint_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t coord_size;
+
+  /* The parameters a restart must share */
+  int32_t num_people;
+  int32_t num_init_infected;
+  int32_t env_width;
+  int32_t env_height;
+  int32_t infection_radius;
+  int32_t disease_duration;
+  int32_t contagiousness_factor;
+  int32_t deadliness_factor;
+  int32_t rank;
+  int32_t num_ranks;
+  uint64_t seed;
+
+  /* The days simulated, the people and infected people of this process,
+   *  and the first day whose infected people have not recovered */
+  int32_t num_days;
+  int32_t num_local_people;
+  int32_t num_infected;
+  int32_t first_infected_day;
+
+  /* The counts (of everyone, in every process) */
+  int32_t num_susceptible;
+  int32_t num_infected_people;
+  int32_t num_immune;
+  int32_t num_dead;
+  double num_infections;
+  double infection_attempts;
+  double num_deaths;
+  double recovery_attempts;
+};
+
+/* A checkpoint being written: a copy of the state, which a writer thread
+ *  writes to path while the simulation carries on */
+struct checkpoint
+{
+  char *path;
+  struct checkpoint_header header;
+  char *data;
+  size_t size;
+  int pending;        /* 1 while the writer thread is writing */
+  pthread_t writer;
+};
+
+/* Return the name of this process's checkpoint file for path -- path itself
+ *  with one process, or path.rank with more */
+char *checkpoint_path(char *path, struct parameters *parameters)
+{
+  char *name = (char*)malloc(strlen(path) + 16);
+
+  if(parameters->num_ranks > 1)
+  {
+    sprintf(name, "%s.%d", path, parameters->rank);
+  }
+  else
+  {
+    strcpy(name, path);
+  }
+
+  return name;
+}
+
+/* Write a checkpoint to a temporary file, flush it to the disk, then rename
+ *  it over the checkpoint, so a crash never leaves half a checkpoint */
+void *checkpoint_writer(void *arg)
+{
+  struct checkpoint *checkpoint = (struct checkpoint*)arg;
+  char *temp_path = (char*)malloc(strlen(checkpoint->path) + 5);
+  FILE *file;
+
+  sprintf(temp_path, "%s.tmp", checkpoint->path);
+  file = fopen(temp_path, "wb");
+  if(file == NULL
+      || fwrite(&checkpoint->header, sizeof(checkpoint->header), 1, file) != 1
+      || fwrite(checkpoint->data, 1, checkpoint->size, file)
+        != checkpoint->size
+      || fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0
+      || rename(temp_path, checkpoint->path) != 0)
+  {
+    fprintf(stderr, "ERROR: cannot write checkpoint %s\n", checkpoint->path);
+    exit(-1);
+  }
+  free(temp_path);
+
+  return NULL;
+}
+
+/* Wait for the checkpoint being written, if any, to be finished */
+void finish_checkpoint(struct checkpoint *checkpoint)
+{
+  if(checkpoint->pending)
+  {
+    pthread_join(checkpoint->writer, NULL);
+    free(checkpoint->data);
+    checkpoint->pending = 0;
+  }
+
+  return;
+}
+
+/* Copy the state at the end of num_days days into a checkpoint, and start
+ *  writing it; the previous checkpoint, if still being written, is finished
+ *  first */
+void start_checkpoint(struct checkpoint *checkpoint,
+    struct parameters *parameters, struct population *population,
+    struct counts *counts, int num_days, int num_people, int first_infected,
+    int end_infected, int first_infected_day)
+{
+  struct checkpoint_header *header = &checkpoint->header;
+  size_t person_size = 2 * sizeof(coord_t) + sizeof(char) + sizeof(uint32_t);
+  char *data;
+  int day;
+
+  finish_checkpoint(checkpoint);
+
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+  header->version = CHECKPOINT_VERSION;
+  header->coord_size = sizeof(coord_t);
+  header->num_people = parameters->num_people;
+  header->num_init_infected = parameters->num_init_infected;
+  header->env_width = parameters->env_width;
+  header->env_height = parameters->env_height;
+  header->infection_radius = parameters->infection_radius;
+  header->disease_duration = parameters->disease_duration;
+  header->contagiousness_factor = parameters->contagiousness_factor;
+  header->deadliness_factor = parameters->deadliness_factor;
+  header->rank = parameters->rank;
+  header->num_ranks = parameters->num_ranks;
+  header->seed = parameters->seed;
+  header->num_days = num_days;
+  header->num_local_people = num_people;
+  header->num_infected = end_infected - first_infected;
+  header->first_infected_day = first_infected_day;
+  header->num_susceptible = counts->num_susceptible;
+  header->num_infected_people = counts->num_infected;
+  header->num_immune = counts->num_immune;
+  header->num_dead = counts->num_dead;
+  header->num_infections = counts->num_infections;
+  header->infection_attempts = counts->infection_attempts;
+  header->num_deaths = counts->num_deaths;
+  header->recovery_attempts = counts->recovery_attempts;
+
+  checkpoint->size = (size_t)num_people * person_size
+    + (size_t)(end_infected - first_infected) * sizeof(int)
+    + (size_t)(num_days - first_infected_day) * sizeof(int);
+  checkpoint->data = data = (char*)malloc(checkpoint->size);
+  if(data == NULL)
+  {
+    fprintf(stderr, "ERROR: cannot allocate %zu bytes for a checkpoint\n", checkpoint->size);
+    exit(-1);
+  }
+
+  memcpy(data, population->xs, num_people * sizeof(coord_t));
+  data += num_people * sizeof(coord_t);
+  memcpy(data, population->ys, num_people * sizeof(coord_t));
+  data += num_people * sizeof(coord_t);
+  memcpy(data, population->states, num_people * sizeof(char));
+  data += num_people * sizeof(char);
+  memcpy(data, population->ids, num_people * sizeof(uint32_t));
+  data += num_people * sizeof(uint32_t);
+  memcpy(data, population->infected + first_infected,
+      (end_infected - first_infected) * sizeof(int));
+  data += (end_infected - first_infected) * sizeof(int);
+  for(day = first_infected_day; day < num_days; day++)
+  {
+    ((int*)data)[day - first_infected_day] = population->cohort_ends[day]
+      - first_infected;
+  }
+
+  if(pthread_create(&checkpoint->writer, NULL, checkpoint_writer,
+        checkpoint) != 0)
+  {
+    fprintf(stderr, "ERROR: cannot start the checkpoint writer\n");
+    exit(-1);
+  }
+  checkpoint->pending = 1;
+
+  return;
+}
+
+/* Restore the state of a run from the checkpoint at path, after checking
+ *  that it is a checkpoint of a run with the same parameters (its seed is
+ *  used). Set the counts, *num_people and *end_infected (the infected
+ *  people are from the front) and return the days simulated. */
+int read_checkpoint(char *path, struct parameters *parameters,
+    struct population *population, struct counts *counts, int *num_people,
+    int *end_infected)
+{
+  struct checkpoint_header header;
+  FILE *file = fopen(path, "rb");
+  int day, n, ok;
+
+  if(file == NULL || fread(&header, sizeof(header), 1, file) != 1)
+  {
+    fprintf(stderr, "ERROR: cannot read checkpoint %s\n", path);
+    exit(-1);
+  }
+  if(memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+      || header.version != CHECKPOINT_VERSION
+      || header.coord_size != sizeof(coord_t))
+  {
+    fprintf(stderr, "ERROR: %s is not a version %d checkpoint with %d-byte coordinates\n", path, CHECKPOINT_VERSION, (int)sizeof(coord_t));
+    exit(-1);
+  }
+  if(header.num_people != parameters->num_people
+      || header.num_init_infected != parameters->num_init_infected
+      || header.env_width != parameters->env_width
+      || header.env_height != parameters->env_height
+      || header.infection_radius != parameters->infection_radius
+      || header.disease_duration != parameters->disease_duration
+      || header.contagiousness_factor != parameters->contagiousness_factor
+      || header.deadliness_factor != parameters->deadliness_factor
+      || header.rank != parameters->rank
+      || header.num_ranks != parameters->num_ranks
+      || header.num_local_people > population->max_people
+      || header.num_infected > population->max_people
+      || header.first_infected_day < 0
+      || header.num_days > population->max_days)
+  {
+    fprintf(stderr, "ERROR: checkpoint %s is of a run with other parameters\n", path);
+    exit(-1);
+  }
+
+  parameters->seed = header.seed;
+  n = *num_people = header.num_local_people;
+  *end_infected = header.num_infected;
+  ok = fread(population->xs, sizeof(coord_t), n, file) == (size_t)n
+    && fread(population->ys, sizeof(coord_t), n, file) == (size_t)n
+    && fread(population->states, sizeof(char), n, file) == (size_t)n
+    && fread(population->ids, sizeof(uint32_t), n, file) == (size_t)n
+    && fread(population->infected, sizeof(int), header.num_infected, file)
+      == (size_t)header.num_infected;
+  for(day = header.first_infected_day; ok && day < header.num_days; day++)
+  {
+    ok = fread(&population->cohort_ends[day], sizeof(int), 1, file) == 1;
+  }
+  fclose(file);
+  if(!ok)
+  {
+    fprintf(stderr, "ERROR: checkpoint %s is truncated\n", path);
+    exit(-1);
+  }
+
+  counts->num_susceptible = header.num_susceptible;
+  counts->num_infected = header.num_infected_people;
+  counts->num_immune = header.num_immune;
+  counts->num_dead = header.num_dead;
+  counts->num_infections = header.num_infections;
+  counts->infection_attempts = header.infection_attempts;
+  counts->num_deaths = header.num_deaths;
+  counts->recovery_attempts = header.recovery_attempts;
+
+  return header.num_days;
+}
+
+/* Run a simulation with the given parameters in the given population's
+ *  arrays, and leave its final counts in counts */
+void simulate(struct parameters *parameters, struct population *population,
+    struct counts *counts)
+{
+  /** Declare variables **/
+  /* People */
+  int num_people = parameters->num_people;
+  int num_init_infected = parameters->num_init_infected;
+  int person1 = 0;
+  int y = 0;
+  int infected_nearby = 0;
+  int num_checks = 0;
+  int person2 = 0;
+  int num_new_infections = 0;
+  int num_new_dead = 0;
+  int num_new_immune = 0;
+  int num_new_attempts = 0;
+  int num_new_recovery_attempts = 0;
+  long long num_new_searches = 0;
+  long long num_new_pair_checks = 0;
+
+  /* Environment */
+  int env_width = parameters->env_width;
+  int env_height = parameters->env_height;
+
+  /* Disease */
+  int infection_radius = parameters->infection_radius;
+  int disease_duration = parameters->disease_duration;
+  int contagiousness_factor = parameters->contagiousness_factor;
+  int deadliness_factor = parameters->deadliness_factor;
+
+  /* Random numbers */
+  uint64_t seed = parameters->seed;
+
+  /* Time */
+  int num_days = parameters->num_days;
+  int current_day = 0;
+  int first_day = 0;
+
+  /* Checkpoints */
+  struct checkpoint checkpoint;
+  char *restart_path;
+
+  /* Profiling */
+  struct profile *profile = parameters->profile;
+  double phase_start = 0.0;
+  double run_start = 0.0;
+
+  /* Movement, a block of people at a time */
+  const int MOVE_BLOCK = 1024;
+  int block = 0;
+
+  /* Kernels */
+  move_kernel move = MOVE_KERNELS[parameters->isa];
+  nearby_kernel nearby = NEARBY_KERNELS[parameters->isa];
+
+  /* Subdomain -- with more than one process, people who move out of this
+   *  process's rows are still within a row of them until the end of the
+   *  day, so infected people from the neighbors within the infection radius
+   *  and one row (the ghost rows) of the edges are counted too */
+  int ghost_rows = (parameters->num_ranks > 1) ? infection_radius + 1 : 0;
+  int row_origin = parameters->row_begin - ghost_rows;
+  int num_ghosts = 0;
+  coord_t *ghosts = population->ghosts;
+#ifdef _MPI
+  int new_counts[5];
+#endif
+
+  /* Spatial index -- the rows of the environment, from row_origin, are
+   *  divided into square cells whose side is the infection radius (at least
+   *  1), so anyone within the radius of a person is in the person's cell or
+   *  one of the 8 around it */
+  int cell_size = (infection_radius > 1) ? infection_radius : 1;
+  int index_width = (env_width + cell_size - 1) / cell_size;
+  int index_height = (parameters->row_end + ghost_rows - row_origin
+      + cell_size - 1) / cell_size;
+  int cell = 0;
+  int cell_x = 0;
+  int cell_y = 0;
+  int first_cell_x = 0;
+  int last_cell_x = 0;
+  int span_begin = 0;
+  int span_end = 0;
+
+  /* Statistics */
+  double last_infection_attempts = 0.0;
+  double last_recovery_attempts = 0.0;
+  double last_num_infections = 0.0;
+  double last_num_deaths = 0.0;
+  int32_t stats_record[9];
+
+  /* Arrays */
+  coord_t *xs = population->xs;
+  coord_t *ys = population->ys;
+  uint32_t *ids = population->ids;
+  int *infected = population->infected;
+  int *cohort_ends = population->cohort_ends;
+  int first_infected = 0;
+  int end_infected = 0;
+  int *cell_starts = population->cell_starts;
+  coord_t *cell_infected_xs = population->cell_infected_xs;
+  coord_t *cell_infected_ys = population->cell_infected_ys;
+  char *states = population->states;
+  char **environment = population->environment;
+
+  /* Loop control */
+  int i;
+
+  if(profile != NULL)
+  {
+    run_start = omp_get_wtime();
+    profile->num_days = num_days;
+    memset(profile->seconds, 0, (size_t)num_days * NUM_PHASES
+        * sizeof(double));
+    profile->susceptible_searches = profile->pair_checks = 0.0;
+  }
+
+  memset(&checkpoint, 0, sizeof(checkpoint));
+  if(parameters->checkpoint_path != NULL)
+  {
+    checkpoint.path = checkpoint_path(parameters->checkpoint_path,
+        parameters);
+  }
+
+  /* Set the counts of infected and susceptible people (of everyone, in
+   *  every process) */
+  memset(counts, 0, sizeof(*counts));
+  counts->num_infected = num_init_infected;
+  counts->num_susceptible = num_people - num_init_infected;
+
+  /* Restart from a checkpoint, with its seed, if there is one */
+  if(parameters->restart_path != NULL)
+  {
+    restart_path = checkpoint_path(parameters->restart_path, parameters);
+    first_day = read_checkpoint(restart_path, parameters, population, counts,
+        &num_people, &end_infected);
+    seed = parameters->seed;
+    free(restart_path);
+  }
+#ifdef _MPI
+  /* With more than one process, place just the people in this process's
+   *  rows */
+  else if(parameters->num_ranks > 1)
+  {
+    num_people = place_subdomain_people(parameters, population,
+        &end_infected);
+  }
+#endif
+  else
+  {
+    /* Set the states of the initially infected people and add them to the
+     * infected people */
+    for(i = 0; i < num_init_infected; i++)
+    {
+      states[i] = INFECTED;
+      infected[end_infected++] = i;
+    }
+
+    /* Set the states of the rest of the people */
+    for(i = num_init_infected; i < num_people; i++)
+    {
+      states[i] = SUSCEPTIBLE;
+    }
+
+    /* Number each person and set random x and y locations for them */
+#pragma omp parallel for
+    for(i = 0; i < num_people; i++)
+    {
+      ids[i] = i;
+      xs[i] = random_number(seed, 0, i, PLACE_X) % env_width;
+      ys[i] = random_number(seed, 0, i, PLACE_Y) % env_height;
+    }
+  }
+
+  last_infection_attempts = counts->infection_attempts;
+  last_recovery_attempts = counts->recovery_attempts;
+  last_num_infections = counts->num_infections;
+  last_num_deaths = counts->num_deaths;
+
+  /* Start a loop to run the simulation for the specified number of days */
+  for(current_day = first_day; current_day < num_days; current_day++)
+  {
+    if(profile != NULL)
+    {
+      phase_start = omp_get_wtime();
+    }
+
+    /* Every reorder_interval days, sort people by cell so the people near
+     *  each other are near each other in memory */
+    if(parameters->reorder_interval > 0 && current_day > 0
+        && current_day % parameters->reorder_interval == 0)
+    {
+      reorder_population(population, num_people, cell_size, index_width,
+          row_origin, index_width * index_height, first_infected,
+          end_infected);
+    }
+    time_phase(profile, current_day, PHASE_REORDER, &phase_start);
+
+#ifdef _MPI
+    /* Get the infected people near this process's rows from the neighbors */
+    if(parameters->num_ranks > 1)
+    {
+      num_ghosts = exchange_ghosts(parameters, population, ghost_rows,
+          first_infected, end_infected);
+    }
+#endif
+    time_phase(profile, current_day, PHASE_EXCHANGE, &phase_start);
+
+    /* Sort the infected locations by cell: count the infected people in
+     *  each cell, turn the counts into starting positions, then place each
+     *  location at its cell's next free position */
+#pragma omp parallel for
+    for(cell = 0; cell <= index_width * index_height; cell++)
+    {
+      cell_starts[cell] = 0;
+    }
+#pragma omp parallel for private(cell)
+    for(i = first_infected; i < end_infected; i++)
+    {
+      cell = ((ys[infected[i]] - row_origin) / cell_size) * index_width
+        + xs[infected[i]] / cell_size;
+#pragma omp atomic
+      cell_starts[cell + 1]++;
+    }
+    for(i = 0; i < num_ghosts; i++)
+    {
+      cell = ((ghosts[2 * i + 1] - row_origin) / cell_size) * index_width
+        + ghosts[2 * i] / cell_size;
+      cell_starts[cell + 1]++;
+    }
+    for(cell = 0; cell < index_width * index_height; cell++)
+    {
+      cell_starts[cell + 1] += cell_starts[cell];
+    }
+#pragma omp parallel for private(cell, person2)
+    for(i = first_infected; i < end_infected; i++)
+    {
+      cell = ((ys[infected[i]] - row_origin) / cell_size) * index_width
+        + xs[infected[i]] / cell_size;
+#pragma omp atomic capture
+      person2 = cell_starts[cell]++;
+      cell_infected_xs[person2] = xs[infected[i]];
+      cell_infected_ys[person2] = ys[infected[i]];
+    }
+    for(i = 0; i < num_ghosts; i++)
+    {
+      cell = ((ghosts[2 * i + 1] - row_origin) / cell_size) * index_width
+        + ghosts[2 * i] / cell_size;
+      person2 = cell_starts[cell]++;
+      cell_infected_xs[person2] = ghosts[2 * i];
+      cell_infected_ys[person2] = ghosts[2 * i + 1];
+    }
+    /* Placing moved each start to the next cell's start; shift them back */
+    for(cell = index_width * index_height; cell > 0; cell--)
+    {
+      cell_starts[cell] = cell_starts[cell - 1];
+    }
+    cell_starts[0] = 0;
+    time_phase(profile, current_day, PHASE_INDEX, &phase_start);
+
+    /* Display a graphic of the current day every frame_interval days, a
+     *  line at a time, and pause for microseconds_per_day */
+    if(parameters->frame_interval > 0
+        && current_day % parameters->frame_interval == 0)
+    {
+      for(y = 0; y < env_height; y++)
+      {
+        memset(environment[y], ' ', env_width);
+      }
+
+      /* Where people share a location, show the infected over the
+       *  susceptible over the immune, whatever order they are stored in */
+      for(i = 0; i < num_people; i++)
+      {
+        if(states[i] == INFECTED || environment[ys[i]][xs[i]] == DEAD
+            || (states[i] == SUSCEPTIBLE
+              && environment[ys[i]][xs[i]] == IMMUNE))
+        {
+          environment[ys[i]][xs[i]] = states[i];
+        }
+      }
+
+      printf("----------------------\n");
+      for(y = 0; y < env_height; y++)
+      {
+        fwrite(environment[y], 1, env_width, stdout);
+        putchar('\n');
+      }
+
+      if(parameters->microseconds_per_day > 0)
+      {
+        fflush(stdout);
+        usleep(parameters->microseconds_per_day);
+      }
+    }
+    time_phase(profile, current_day, PHASE_DISPLAY, &phase_start);
+
+    /* Move each person, a block of people at a time */
+#pragma omp parallel for
+    for(block = 0; block < num_people; block += MOVE_BLOCK)
+    {
+      move(xs, ys, states, ids, block, (block + MOVE_BLOCK < num_people)
+          ? block + MOVE_BLOCK : num_people, seed, current_day, env_width,
+          env_height);
+    }
+    time_phase(profile, current_day, PHASE_MOVEMENT, &phase_start);
+
+    /* For each person, do the following (counting the new infections and
+     *  attempts across threads, and adding the newly infected to the
+     *  infected people in whatever order the threads find them; the order
+     *  within a day does not matter) */
+    num_new_infections = 0;
+    num_new_attempts = 0;
+    num_new_searches = 0;
+    num_new_pair_checks = 0;
+#pragma omp parallel for private(infected_nearby, num_checks, cell_x, \
+    cell_y, first_cell_x, last_cell_x, span_begin, span_end, person2) \
+    reduction(+:num_new_infections, num_new_attempts, num_new_searches, \
+        num_new_pair_checks)
+    for(person1 = 0; person1 < num_people; person1++)
+    {
+      /* If the person is susceptible, then */
+      if(states[person1] == SUSCEPTIBLE)
+      {
+        /* Look for an infected person within the infection radius in
+         *  person1's cell and the cells around it -- the infected in a row
+         *  of up to 3 cells are next to each other in the index, so each
+         *  row is one span for the kernel */
+        infected_nearby = 0;
+        cell_x = xs[person1] / cell_size;
+        first_cell_x = (cell_x > 0) ? cell_x - 1 : 0;
+        last_cell_x = (cell_x < index_width - 1) ? cell_x + 1 : cell_x;
+        for(cell_y = (ys[person1] - row_origin) / cell_size - 1;
+            cell_y <= (ys[person1] - row_origin) / cell_size + 1
+            && infected_nearby < 1;
+            cell_y++)
+        {
+          /* Skip rows outside the environment */
+          if(cell_y < 0 || cell_y >= index_height)
+          {
+            continue;
+          }
+
+          span_begin = cell_starts[cell_y * index_width + first_cell_x];
+          span_end = cell_starts[cell_y * index_width + last_cell_x + 1];
+          infected_nearby = nearby(cell_infected_xs, cell_infected_ys,
+              span_begin, span_end, xs[person1], ys[person1],
+              infection_radius, &num_checks);
+          num_new_pair_checks += num_checks;
+        }
+        num_new_searches++;
+
+        if(infected_nearby >= 1)
+        {
+          num_new_attempts++;
+        }
+
+        /* If there is at least one infected person nearby, and a random number
+         *  less than 100 is less than the contagiousness factor,
+         *  then */
+        if(infected_nearby >= 1 && (int)(random_number(seed, current_day,
+                ids[person1], INFECT) % 100) < contagiousness_factor)
+        {
+          /* Change person1's state to infected */
+          states[person1] = INFECTED;
+#pragma omp atomic capture
+          person2 = end_infected++;
+          infected[person2] = person1;
+
+          /* Update the counter */
+          num_new_infections++;
+        }
+      }
+    }
+    if(profile != NULL)
+    {
+      profile->susceptible_searches += num_new_searches;
+      profile->pair_checks += num_new_pair_checks;
+    }
+    time_phase(profile, current_day, PHASE_INFECTION, &phase_start);
+
+    cohort_ends[current_day] = end_infected;
+
+    /* For each person infected disease_duration days ago, who has now been
+     *  infected for the full duration of the disease, do the following
+     *  (counting the new dead and immune and the attempts across threads) */
+    num_new_dead = 0;
+    num_new_immune = 0;
+    num_new_recovery_attempts = 0;
+    if(disease_duration >= 0 && current_day >= disease_duration)
+    {
+#pragma omp parallel for private(person1) reduction(+:num_new_dead, \
+    num_new_immune, num_new_recovery_attempts)
+      for(i = first_infected; i < cohort_ends[current_day - disease_duration];
+          i++)
+      {
+        person1 = infected[i];
+        num_new_recovery_attempts++;
+
+        /* If a random number less than 100 is less than the deadliness
+         *  factor, then */
+        if((int)(random_number(seed, current_day, ids[person1], RECOVER) % 100)
+            < deadliness_factor)
+        {
+          /* Change the person's state to dead */
+          states[person1] = DEAD;
+
+          /* Update the counter */
+          num_new_dead++;
+        }
+        /* Otherwise, */
+        else
+        {
+          /* Change the person's state to immune */
+          states[person1] = IMMUNE;
+
+          /* Update the counter */
+          num_new_immune++;
+        }
+      }
+
+      /* They are no longer infected */
+      first_infected = cohort_ends[current_day - disease_duration];
+    }
+    time_phase(profile, current_day, PHASE_RECOVERY, &phase_start);
+
+#ifdef _MPI
+    /* With more than one process, trade the people who have moved out of
+     *  this process's rows, and add up the day's new counts of every
+     *  process */
+    if(parameters->num_ranks > 1)
+    {
+      num_people = migrate_people(parameters, population, num_people,
+          first_infected, &end_infected, (disease_duration >= 0
+            && current_day >= disease_duration)
+          ? current_day - disease_duration + 1 : 0, current_day);
+      first_infected = 0;
+
+      new_counts[0] = num_new_infections;
+      new_counts[1] = num_new_attempts;
+      new_counts[2] = num_new_dead;
+      new_counts[3] = num_new_immune;
+      new_counts[4] = num_new_recovery_attempts;
+      MPI_Allreduce(MPI_IN_PLACE, new_counts, 5, MPI_INT, MPI_SUM,
+          MPI_COMM_WORLD);
+      num_new_infections = new_counts[0];
+      num_new_attempts = new_counts[1];
+      num_new_dead = new_counts[2];
+      num_new_immune = new_counts[3];
+      num_new_recovery_attempts = new_counts[4];
+    }
+#endif
+    time_phase(profile, current_day, PHASE_MIGRATION, &phase_start);
+
+    counts->num_infected += num_new_infections;
+    counts->num_susceptible -= num_new_infections;
+    counts->num_infections += num_new_infections;
+    counts->infection_attempts += num_new_attempts;
+    counts->num_dead += num_new_dead;
+    counts->num_deaths += num_new_dead;
+    counts->num_immune += num_new_immune;
+    counts->num_infected -= num_new_dead + num_new_immune;
+    counts->recovery_attempts += num_new_recovery_attempts;
+
+    /* Write the day's counts, and the attempts, infections and deaths
+     *  since the day before, to the statistics file */
+    if(parameters->stats_file != NULL)
+    {
+      stats_record[0] = current_day + 1;
+      stats_record[1] = counts->num_susceptible;
+      stats_record[2] = counts->num_infected;
+      stats_record[3] = counts->num_immune;
+      stats_record[4] = counts->num_dead;
+      stats_record[5] = counts->infection_attempts - last_infection_attempts;
+      stats_record[6] = counts->num_infections - last_num_infections;
+      stats_record[7] = counts->recovery_attempts - last_recovery_attempts;
+      stats_record[8] = counts->num_deaths - last_num_deaths;
+      last_infection_attempts = counts->infection_attempts;
+      last_num_infections = counts->num_infections;
+      last_recovery_attempts = counts->recovery_attempts;
+      last_num_deaths = counts->num_deaths;
+      if(parameters->stats_format == STATS_BINARY)
+      {
+        fwrite(stats_record, sizeof(int32_t), NUM_STATS_FIELDS,
+            parameters->stats_file);
+      }
+      else
+      {
+        fprintf(parameters->stats_file, "%d,%d,%d,%d,%d,%d,%d,%d,%d\n", stats_record[0],
+            stats_record[1], stats_record[2], stats_record[3], stats_record[4],
+            stats_record[5], stats_record[6], stats_record[7],
+            stats_record[8]);
+      }
+    }
+    time_phase(profile, current_day, PHASE_OUTPUT, &phase_start);
+
+    /* Every checkpoint_interval days, start writing a checkpoint */
+    if(checkpoint.path != NULL
+        && (current_day + 1) % parameters->checkpoint_interval == 0)
+    {
+      start_checkpoint(&checkpoint, parameters, population, counts,
+          current_day + 1, num_people, first_infected, end_infected,
+          (disease_duration >= 0 && current_day >= disease_duration)
+          ? current_day - disease_duration + 1 : 0);
+    }
+    time_phase(profile, current_day, PHASE_CHECKPOINT, &phase_start);
+  }
+
+  /* Wait for the last checkpoint to be written */
+  finish_checkpoint(&checkpoint);
+  free(checkpoint.path);
+
+  if(profile != NULL)
+  {
+    profile->total_seconds = omp_get_wtime() - run_start;
+  }
+
+  return;
+}
+
+/* Ensembles -- each of the swept parameters (contagiousness factor,
+ *  deadliness factor, infection radius and disease duration, in that order)
+ *  takes a range first:last:step, and every combination of them is a
+ *  parameter point. Each point is run num_replicas times, each replica with
+ *  its own seed drawn from the base seed, the point and the replica number,
+ *  so results do not depend on which thread ran what. */
+#define NUM_SWEPT 4
+#define NUM_METRICS 6
+
+/* Parse a range "first", "first:last" or "first:last:step" into first, last
+ *  and step; return 0 on success, or print an error and return -1 */
+int parse_range(char *name, char *string, int range[3])
+{
+  int num_fields;
+
+  range[2] = 1;
+  num_fields = sscanf(string, "%d:%d:%d", &range[0], &range[1], &range[2]);
+  if(num_fields == 1)
+  {
+    range[1] = range[0];
+  }
+  if(num_fields < 1 || range[1] < range[0] || range[2] < 1)
+  {
+    fprintf(stderr, "ERROR: %s (%s) must be a number or first:last[:step] with first <= last and step >= 1\n", name, string);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Return the value of swept parameter number swept at a parameter point,
+ *  the first swept parameter varying slowest */
+int point_value(int ranges[NUM_SWEPT][3], int num_values[NUM_SWEPT],
+    int point, int swept)
+{
+  int later;
+
+  for(later = NUM_SWEPT - 1; later > swept; later--)
+  {
+    point /= num_values[later];
+  }
+
+  return ranges[swept][0] + (point % num_values[swept]) * ranges[swept][2];
+}
+
+/* Return the critical value of Student's t distribution for a two-sided 95%
+ *  confidence interval with the given degrees of freedom */
+double t_critical_95(int degrees_of_freedom)
+{
+  const double table[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+
+  if(degrees_of_freedom <= 30)
+  {
+    return table[degrees_of_freedom - 1];
+  }
+  return 1.960;
+}
+
+/* Run every parameter point of the ranges num_replicas times on a pool of
+ *  threads, and print each point's mean, variance and 95% confidence
+ *  interval half-width of the final counts and the actual contagiousness and
+ *  deadliness as comma-separated text */
+void run_ensemble(struct parameters *base, int ranges[NUM_SWEPT][3],
+    int num_replicas)
+{
+  const char *metric_names[NUM_METRICS] = { "susceptible", "infected",
+    "immune", "dead", "contagiousness", "deadliness" };
+  int num_values[NUM_SWEPT];
+  int num_points = 1;
+  int point, replica, task, swept, metric;
+  double *results, *result, mean, variance;
+  struct parameters parameters;
+  struct population population;
+  struct counts counts;
+
+  for(swept = 0; swept < NUM_SWEPT; swept++)
+  {
+    num_values[swept] = (ranges[swept][1] - ranges[swept][0])
+      / ranges[swept][2] + 1;
+    num_points *= num_values[swept];
+  }
+  results = (double*)malloc((size_t)num_points * num_replicas * NUM_METRICS
+      * sizeof(double));
+
+  /* Each thread allocates one population and reuses it for every replica it
+   *  runs; replicas are handed out as threads become free. The loops inside
+   *  a simulation run on the one thread running it. */
+#pragma omp parallel private(parameters, population, counts, point, \
+    replica, result)
+  {
+    alloc_population(&population, base->num_people, 0, base->env_width,
+        base->env_height, base->num_days, ranges[2][0], 0);
+
+#pragma omp for schedule(dynamic)
+    for(task = 0; task < num_points * num_replicas; task++)
+    {
+      point = task / num_replicas;
+      replica = task % num_replicas;
+
+      parameters = *base;
+      parameters.contagiousness_factor = point_value(ranges, num_values,
+          point, 0);
+      parameters.deadliness_factor = point_value(ranges, num_values, point,
+          1);
+      parameters.infection_radius = point_value(ranges, num_values, point, 2);
+      parameters.disease_duration = point_value(ranges, num_values, point, 3);
+      parameters.seed = ((uint64_t)random_number(base->seed, point, replica,
+            REPLICA_SEED_HIGH) << 32)
+        | random_number(base->seed, point, replica, REPLICA_SEED_LOW);
+      parameters.frame_interval = 0;
+      parameters.stats_file = NULL;
+
+      simulate(&parameters, &population, &counts);
+
+      result = &results[(size_t)task * NUM_METRICS];
+      result[0] = counts.num_susceptible;
+      result[1] = counts.num_infected;
+      result[2] = counts.num_immune;
+      result[3] = counts.num_dead;
+      result[4] = 100.0 * (counts.num_infections
+          / (counts.infection_attempts == 0 ? 1 : counts.infection_attempts));
+      result[5] = 100.0 * (counts.num_deaths
+          / (counts.recovery_attempts == 0 ? 1 : counts.recovery_attempts));
+    }
+
+    free_population(&population);
+  }
+
+  /* Print a line per point, summing its replicas in order so the output is
+   *  the same however many threads ran them */
+  printf("contagiousness_factor,deadliness_factor,infection_radius,disease_duration,replicas");
+  for(metric = 0; metric < NUM_METRICS; metric++)
+  {
+    printf(",%s_mean,%s_variance,%s_ci95", metric_names[metric],
+        metric_names[metric], metric_names[metric]);
+  }
+  printf("\n");
+
+  for(point = 0; point < num_points; point++)
+  {
+    for(swept = 0; swept < NUM_SWEPT; swept++)
+    {
+      printf("%d,", point_value(ranges, num_values, point, swept));
+    }
+    printf("%d", num_replicas);
+
+    result = &results[(size_t)point * num_replicas * NUM_METRICS];
+    for(metric = 0; metric < NUM_METRICS; metric++)
+    {
+      mean = 0.0;
+      for(replica = 0; replica < num_replicas; replica++)
+      {
+        mean += result[replica * NUM_METRICS + metric];
+      }
+      mean /= num_replicas;
+
+      variance = 0.0;
+      for(replica = 0; replica < num_replicas; replica++)
+      {
+        variance += (result[replica * NUM_METRICS + metric] - mean)
+          * (result[replica * NUM_METRICS + metric] - mean);
+      }
+      variance = (num_replicas > 1) ? variance / (num_replicas - 1) : 0.0;
+
+      printf(",%f,%f,%f", mean, variance, (num_replicas > 1)
+          ? t_critical_95(num_replicas - 1) * sqrt(variance / num_replicas)
+          : 0.0);
+    }
+    printf("\n");
+  }
+
+  free(results);
+
+  return;
+}
+
 /* PROGRAM EXECUTION BEGINS HERE */
 int main(int argc, char** argv)
 {
   /** Declare variables **/
-  /* People */
-  int num_infected = 0;
-  int new_num_infected = 0;
-  int num_people = 50;
-  int person1 = 0;
-  int num_init_infected = 1;
-  int x = 0;
-  int y = 0;
-  int num_susceptible = 0;
-  int num_immune = 0;
-  int num_dead = 0;
-  int infected_nearby = 0;
-  int person2 = 0;
+  /* The parameters of the simulation, and its final counts */
+  struct parameters parameters = {
+    50,     /* num_people */
+    1,      /* num_init_infected */
+    30,     /* env_width */
+    30,     /* env_height */
+    1,      /* infection_radius */
+    50,     /* disease_duration */
+    30,     /* contagiousness_factor */
+    30,     /* deadliness_factor */
+    250,    /* num_days */
+    0,      /* microseconds_per_day */
+    10,     /* reorder_interval */
+    0,      /* seed */
+    ISA_AUTO, /* isa */
+    0,      /* rank */
+    1,      /* num_ranks */
+    0,      /* row_begin */
+    0,      /* row_end */
+    1,      /* frame_interval */
+    NULL,   /* stats_file */
+    0,      /* stats_format */
+    NULL,   /* profile */
+    NULL,   /* checkpoint_path */
+    100,    /* checkpoint_interval */
+    NULL    /* restart_path */
+  };
+  struct counts counts;
+  struct population population;
 
-  /* Environment */
-  int env_width = 30;
-  int env_height = 30;
+  /* People in this process's rows -- all of them, with one process, or
+   *  else room for twice the even share, as they crowd into some rows as
+   *  they move */
+  int max_people;
 
-  /* Disease */
-  int infection_radius = 1;
-  int disease_duration = 50;
-  int contagiousness_factor = 30;
-  int deadliness_factor = 30;
-  double num_infections = 0.0;
-  double infection_attempts = 0.0;
-  double num_deaths = 0.0;
-  double recovery_attempts = 0.0;
+  /* Ensembles -- ranges of the contagiousness factor, deadliness factor,
+   *  infection radius and disease duration, and the number of replicas of
+   *  each point (0 for a single run) */
+  int ranges[NUM_SWEPT][3];
+  int num_replicas = 0;
 
-  /* Time */
-  int num_days = 250;
-  int current_day = 0;
-  int microseconds_per_day = 100000;
+  /* Statistics file */
+  char *stats_path = NULL;
 
-  /* Movement */
-  int x_dir = 0; 
-  int y_dir = 0;
+  /* Profile, and the file to write it to */
+  struct profile profile;
+  char *profile_path = NULL;
+  FILE *profile_file;
+
+  /* Threads */
+  int num_threads = omp_get_max_threads();
 
   /* getopt */
   int c = 0;
+  int error = 0;
 
-  /* Integer arrays, a.k.a. integer pointers */
-  int *xs;
-  int *ys;
-  int *infected_xs;
-  int *infected_ys;
-  int *days_infected;
-
-  /* Character arrays, a.k.a. character pointers */
-  char *states;
+  /* Loop control */
+  int swept;
 
-  /* Array of character arrays, a.k.a. array of character pointers, for text
-   *  display */
-  char **environment;
+#ifdef _MPI
+  /* Start MPI; only the main thread calls it */
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &c);
+  MPI_Comm_rank(MPI_COMM_WORLD, &parameters.rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &parameters.num_ranks);
+#endif
 
-  /* Loop control */
-  int i;
+  /* Seed the random numbers based on the current time unless told
+   *  otherwise */
+  parameters.seed = time(NULL);
+  for(swept = 0; swept < NUM_SWEPT; swept++)
+  {
+    ranges[swept][0] = ranges[swept][1] = 0;
+    ranges[swept][2] = 1;
+  }
+  ranges[0][0] = ranges[0][1] = parameters.contagiousness_factor;
+  ranges[1][0] = ranges[1][1] = parameters.deadliness_factor;
+  ranges[2][0] = ranges[2][1] = parameters.infection_radius;
+  ranges[3][0] = ranges[3][1] = parameters.disease_duration;
 
   /* Get command line options -- this follows the idiom presented in the
    *  getopt man page (enter 'man 3 getopt' on the shell for more) */
-  while((c = getopt(argc, argv, "n:i:w:h:t:T:c:d:D:m:")) != -1)
+  while((c = getopt(argc, argv, "n:i:w:h:t:T:c:d:D:m:r:s:k:p:F:o:f:j:C:W:L:E:")) != -1)
   {
     switch(c)
     {
       case 'n':
-        num_people = atoi(optarg);
+        parameters.num_people = atoi(optarg);
         break;
       case 'i':
-        num_init_infected = atoi(optarg);
+        parameters.num_init_infected = atoi(optarg);
         break;
       case 'w':
-        env_width = atoi(optarg);
+        parameters.env_width = atoi(optarg);
         break;
       case 'h':
-        env_height = atoi(optarg);
+        parameters.env_height = atoi(optarg);
         break;
       case 't':
-        num_days = atoi(optarg);
+        parameters.num_days = atoi(optarg);
         break;
       case 'T':
-        disease_duration = atoi(optarg);
+        error += parse_range("disease duration", optarg, ranges[3]);
         break;
       case 'c':
-        contagiousness_factor = atoi(optarg);
+        error += parse_range("contagiousness factor", optarg, ranges[0]);
         break;
       case 'd':
-        infection_radius = atoi(optarg);
+        error += parse_range("infection radius", optarg, ranges[2]);
         break;
       case 'D':
-        deadliness_factor = atoi(optarg);
+        error += parse_range("deadliness factor", optarg, ranges[1]);
         break;
       case 'm':
-        microseconds_per_day = atoi(optarg);
+        parameters.microseconds_per_day = atoi(optarg);
+        break;
+      case 'r':
+        parameters.reorder_interval = atoi(optarg);
+        break;
+      case 's':
+        parameters.seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'k':
+        if(strcmp(optarg, "auto") == 0)
+        {
+          parameters.isa = ISA_AUTO;
+        }
+        else if(strcmp(optarg, "plain") == 0)
+        {
+          parameters.isa = ISA_PLAIN;
+        }
+        else if(strcmp(optarg, "avx2") == 0)
+        {
+          parameters.isa = ISA_AVX2;
+        }
+        else if(strcmp(optarg, "avx512") == 0)
+        {
+          parameters.isa = ISA_AVX512;
+        }
+        else
+        {
+          fprintf(stderr, "ERROR: kernel (%s) must be auto, plain, avx2 or avx512\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'p':
+        num_threads = atoi(optarg);
+        break;
+      case 'F':
+        parameters.frame_interval = atoi(optarg);
+        break;
+      case 'o':
+        stats_path = optarg;
+        break;
+      case 'f':
+        if(strcmp(optarg, "csv") == 0)
+        {
+          parameters.stats_format = STATS_CSV;
+        }
+        else if(strcmp(optarg, "binary") == 0)
+        {
+          parameters.stats_format = STATS_BINARY;
+        }
+        else
+        {
+          fprintf(stderr, "ERROR: statistics format (%s) must be csv or binary\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'j':
+        profile_path = optarg;
+        break;
+      case 'C':
+        parameters.checkpoint_path = optarg;
+        break;
+      case 'W':
+        parameters.checkpoint_interval = atoi(optarg);
+        break;
+      case 'L':
+        parameters.restart_path = optarg;
+        break;
+      case 'E':
+        num_replicas = atoi(optarg);
         break;
         /* If the user entered "-?" or an unrecognized option, we need 
          *  to print a usage message before exiting. */
       case '?':
       default:
         fprintf(stderr, "Usage: ");
-        fprintf(stderr, "%s [-n num_people][-i num_init_infected][-w env_width][-h env_height][-t num_days][-T disease_duration][-c contagiousness_factor][-d infection_radius][-D deadliness_factor][-m microseconds_per_day]\n", argv[0]);
+        fprintf(stderr, "%s [-n num_people][-i num_init_infected][-w env_width][-h env_height][-t num_days][-T disease_duration][-c contagiousness_factor][-d infection_radius][-D deadliness_factor][-m microseconds_per_day][-r reorder_interval][-s seed][-k auto|plain|avx2|avx512][-p num_threads][-F frame_interval][-o stats_file][-f csv|binary][-j profile_file][-C checkpoint_file][-W checkpoint_interval][-L checkpoint_file][-E num_replicas]\n", argv[0]);
+        fprintf(stderr, "With -E, each of -c, -D, -d and -T may be a range first:last[:step]\n");
         exit(-1);
     }
   }
   argc -= optind;
   argv += optind;
 
+  /* Exit if a range was malformed */
+  if(error != 0)
+  {
+    exit(-1);
+  }
+  parameters.contagiousness_factor = ranges[0][0];
+  parameters.deadliness_factor = ranges[1][0];
+  parameters.infection_radius = ranges[2][0];
+  parameters.disease_duration = ranges[3][0];
+
   /* Make sure that the total number of initially infected people is less than
    * the total number of people */
-  if(num_init_infected > num_people)
+  if(parameters.num_init_infected > parameters.num_people)
+  {
+    fprintf(stderr, "ERROR: initial number of infected (%d) must be less than total number of people (%d)\n", parameters.num_init_infected, parameters.num_people);
+    exit(-1);
+  }
+
+  /* Make sure that the environment fits in the coordinates */
+  if(parameters.env_width < 1 || parameters.env_width > MAX_ENV_SIZE
+      || parameters.env_height < 1 || parameters.env_height > MAX_ENV_SIZE)
   {
-    fprintf(stderr, "ERROR: initial number of infected (%d) must be less than total number of people (%d)\n", num_init_infected, num_people);
+    fprintf(stderr, "ERROR: environment (%d by %d) must be from 1 to %d wide and high\n", parameters.env_width, parameters.env_height, MAX_ENV_SIZE);
     exit(-1);
   }
 
-  /* Allocate the arrays */
-  xs = (int*)malloc(num_people * sizeof(int));
-  ys = (int*)malloc(num_people * sizeof(int));
-  infected_xs = (int*)malloc(num_people * sizeof(int));
-  infected_ys = (int*)malloc(num_people * sizeof(int));
-  days_infected = (int*)malloc(num_people * sizeof(int));
-  states = (char*)malloc(num_people * sizeof(char));
-  environment = (char**)malloc(env_height * env_width * sizeof(char*));
-  for(y = 0; y < env_height; y++)
+  /* Give each process an even share of the rows, each at least one more
+   *  than the infection radius so the infected people near its edges are
+   *  all in its neighbors' rows; only the first process writes output */
+  parameters.row_begin = (int)((long long)parameters.env_height
+      * parameters.rank / parameters.num_ranks);
+  parameters.row_end = (int)((long long)parameters.env_height
+      * (parameters.rank + 1) / parameters.num_ranks);
+  if(parameters.num_ranks > 1)
   {
-    environment[y] = (char*)malloc(env_width * sizeof(char));
+    if(parameters.env_height / parameters.num_ranks
+        < parameters.infection_radius + 1)
+    {
+      fprintf(stderr, "ERROR: environment height (%d) must be at least %d for %d processes\n", parameters.env_height, parameters.num_ranks * (parameters.infection_radius + 1), parameters.num_ranks);
+      exit(-1);
+    }
+    if(parameters.frame_interval > 0 || num_replicas > 0)
+    {
+      fprintf(stderr, "ERROR: with more than one process, there must be no display (-F 0) or ensemble\n");
+      exit(-1);
+    }
+    if(parameters.rank > 0)
+    {
+      stats_path = NULL;
+    }
   }
+#ifdef _MPI
+  MPI_Bcast(&parameters.seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+#endif
 
-  /* Seed the random number generator based on the current time */
-  srandom(time(NULL));
+  /* Make sure that the checkpoint interval is positive */
+  if(parameters.checkpoint_interval < 1)
+  {
+    fprintf(stderr, "ERROR: checkpoint interval (%d) must be at least 1\n", parameters.checkpoint_interval);
+    exit(-1);
+  }
 
-  /* Set the states of the initially infected people and set
-   * the count of infected people */
-  for(i = 0; i < num_init_infected; i++)
+  /* Make sure that the reorder interval is not negative */
+  if(parameters.reorder_interval < 0)
   {
-    states[i] = INFECTED;
-    num_infected++;
+    fprintf(stderr, "ERROR: reorder interval (%d) must be at least 0\n", parameters.reorder_interval);
+    exit(-1);
   }
 
-  /* Set the states of the rest of the people and set the
-   * count of susceptible people */
-  for(i = num_init_infected; i < num_people; i++)
+  /* Choose the kernels */
+  parameters.isa = choose_isa(parameters.isa);
+  if(parameters.isa < 0)
   {
-    states[i] = SUSCEPTIBLE;
-    num_susceptible++;
+    exit(-1);
   }
 
-  /* Set random x and y locations for each person */
-  for(i = 0; i < num_people; i++)
+  /* Make sure that there is at least one thread */
+  if(num_threads < 1)
   {
-    xs[i] = random() % env_width;
-    ys[i] = random() % env_height;
+    fprintf(stderr, "ERROR: number of threads (%d) must be at least 1\n", num_threads);
+    exit(-1);
   }
+  omp_set_num_threads(num_threads);
 
-  /* Initialize the number of days infected of each person
-   * to 0 */
-  for(i = 0; i < num_people; i++)
+  /* Make sure that the frame interval is not negative */
+  if(parameters.frame_interval < 0)
   {
-    days_infected[i] = 0;
+    fprintf(stderr, "ERROR: frame interval (%d) must be at least 0\n", parameters.frame_interval);
+    exit(-1);
   }
 
-  /* Start a loop to run the simulation for the specified number of days */
-  for(current_day = 0; current_day < num_days; current_day++)
+  /* Make sure that ranges are only given for ensembles, and that ensembles
+   *  have at least one replica and no display or statistics file */
+  if(num_replicas < 0)
   {
-    /* Determine infected x locations and infected y locations */
-    i = 0;
-    for(person1 = 0; person1 < num_people; person1++)
+    fprintf(stderr, "ERROR: number of replicas (%d) must be at least 1\n", num_replicas);
+    exit(-1);
+  }
+  for(swept = 0; swept < NUM_SWEPT; swept++)
+  {
+    if(num_replicas == 0 && ranges[swept][1] != ranges[swept][0])
     {
-      if(states[person1] == INFECTED)
-      {
-        infected_xs[i] = xs[person1];
-        infected_ys[i] = ys[person1];
-        i++;
-      }
+      fprintf(stderr, "ERROR: ranges of parameters need an ensemble (-E)\n");
+      exit(-1);
     }
+  }
+  if(num_replicas > 0 && (stats_path != NULL || profile_path != NULL
+        || parameters.checkpoint_path != NULL
+        || parameters.restart_path != NULL))
+  {
+    fprintf(stderr, "ERROR: ensembles do not write a statistics file, profile or checkpoints, or restart\n");
+    exit(-1);
+  }
 
-    /* Display a graphic of the current day */
-    for(y = 0; y < env_height; y++)
+  /* Run the ensemble, or else run a single simulation */
+  if(num_replicas > 0)
+  {
+    run_ensemble(&parameters, ranges, num_replicas);
+#ifdef _MPI
+    MPI_Finalize();
+#endif
+    return 0;
+  }
+
+  /* Open the statistics file and write its header */
+  if(stats_path != NULL)
+  {
+    parameters.stats_file = fopen(stats_path,
+        (parameters.stats_format == STATS_BINARY) ? "wb" : "w");
+    if(parameters.stats_file == NULL)
     {
-      for(x = 0; x < env_width; x++)
-      {
-        environment[y][x] = ' ';
-      }
+      fprintf(stderr, "ERROR: cannot open statistics file %s\n", stats_path);
+      exit(-1);
     }
-
-    for(i = 0; i < num_people; i++)
+    if(parameters.stats_format == STATS_BINARY)
     {
-      environment[ys[i]][xs[i]] = states[i];
+      fwrite("PANDSTAT", 1, 8, parameters.stats_file);
+      fwrite(&STATS_VERSION, sizeof(uint32_t), 1, parameters.stats_file);
+      fwrite(&NUM_STATS_FIELDS, sizeof(uint32_t), 1, parameters.stats_file);
     }
-
-    printf("----------------------\n");
-    for(y = 0; y < env_height; y++)
+    else
     {
-      for(x = 0; x < env_width; x++)
-      {
-        printf("%c", environment[y][x]);
-      }
-      printf("\n");
+      fprintf(parameters.stats_file, "day,susceptible,infected,immune,dead,infection_attempts,infections,recovery_attempts,deaths\n");
     }
+  }
 
-    /* For each person, do the following */
-    for(i = 0; i < num_people; i++)
+  /* Allocate the arrays -- with more than one process, for the rows of
+   *  this process and its ghost rows */
+  max_people = parameters.num_people;
+  if(parameters.num_ranks > 1)
+  {
+    max_people = 2 * (parameters.num_people / parameters.num_ranks) + 1024;
+    if(max_people > parameters.num_people)
     {
-      /* If the person is not dead, then */
-      if(states[i] != DEAD)
-      {
-        /* Randomly pick whether the person moves left or right or does not move
-         * in the x dimension */
-        x_dir = (random() % 3) - 1;
-
-        /* Randomly pick whether the person moves up or down or does not move
-         * in the y dimension */
-        y_dir = (random() % 3) - 1;
-
-        /* If the person will remain in the bounds of the environment after
-         * moving, then */
-        if((xs[i] + x_dir >= 0) &&
-           (xs[i] + x_dir < env_width) &&
-           (ys[i] + y_dir >= 0) &&
-           (ys[i] + y_dir < env_height))
-        {
-          /* Move the person */
-          xs[i] += x_dir;
-          ys[i] += y_dir;
-        }
-      }
+      max_people = parameters.num_people;
     }
+  }
+  alloc_population(&population, max_people,
+      (parameters.num_ranks > 1) ? 2 * max_people : 0, parameters.env_width,
+      parameters.row_end - parameters.row_begin
+      + 2 * ((parameters.num_ranks > 1) ? parameters.infection_radius + 1 : 0),
+      parameters.num_days, parameters.infection_radius,
+      parameters.frame_interval > 0);
 
-    new_num_infected = num_infected;
-    /* For each person, do the following */
-    for(person1 = 0; person1 < num_people; person1++)
+  /* Time each phase of each day if asked to, opening the profile file
+   *  first so as not to find it cannot be written after the run */
+  profile_file = NULL;
+  if(profile_path != NULL)
+  {
+    if(parameters.rank == 0)
     {
-      /* If the person is susceptible, then */
-      if(states[person1] == SUSCEPTIBLE)
+      profile_file = fopen(profile_path, "w");
+      if(profile_file == NULL)
       {
-        /* For each of the infected people or until the number of infected 
-         *  people nearby is 1, the thread does the following */
-        infected_nearby = 0;
-        for(person2 = 0; person2 < num_infected && infected_nearby < 1;
-            person2++)
-        {
-          /* If person 1 is within the infection radius, then */
-          if((xs[person1] >= infected_xs[person2] - infection_radius) &&
-             (xs[person1] <= infected_xs[person2] + infection_radius) &&
-             (ys[person1] >= infected_ys[person2] - infection_radius) &&
-             (ys[person1] <= infected_ys[person2] + infection_radius))
-          {
-            /* Increment the number of infected people nearby */
-            infected_nearby++;
-          }
-        }
-
-        if(infected_nearby >= 1)
-        {
-          infection_attempts++;
-        }
-
-        /* If there is at least one infected person nearby, and a random number
-         *  less than 100 is less than the contagiousness factor,
-         *  then */
-        if(infected_nearby >= 1 && (random() % 100) < contagiousness_factor)
-        {
-          /* Change person1's state to infected */
-          states[person1] = INFECTED;
-
-          /* Update the counters */
-          new_num_infected++;
-          num_susceptible--;
-          num_infections++;
-        }
+        fprintf(stderr, "ERROR: cannot open profile file %s\n", profile_path);
+        exit(-1);
       }
     }
-    num_infected = new_num_infected;
-
-    /* For each person, do the following */
-    for(i = 0; i < num_people; i++)
-    {
-      /* If the person is infected and has been for the full duration of the
-       *  disease, then */
-      if(states[i] == INFECTED && days_infected[i] == disease_duration)
-      {
-        recovery_attempts++;
-
-        /* If a random number less than 100 is less than the deadliness
-         *  factor, then */
-        if((random() % 100) < deadliness_factor)
-        {
-          /* Change the person's state to dead */
-          states[i] = DEAD;
+    profile.seconds = (double*)malloc((size_t)parameters.num_days
+        * NUM_PHASES * sizeof(double));
+    parameters.profile = &profile;
+  }
 
-          /* Update the counters */
-          num_dead++;
-          num_infected--;
-          num_deaths++;
-        }
-        /* Otherwise, */
-        else
-        {
-          /* Change the person's state to immune */
-          states[i] = IMMUNE;
+  /* Run the simulation for the specified number of days */
+  simulate(&parameters, &population, &counts);
 
-          /* Update the counters */
-          num_immune++;
-          num_infected--;
-        }
-      }
+  /* Write the profile -- with more than one process, of the slowest
+   *  process for each phase of each day, and the sums of the counters */
+  if(profile_path != NULL)
+  {
+#ifdef _MPI
+    if(parameters.num_ranks > 1)
+    {
+      MPI_Reduce((parameters.rank == 0) ? MPI_IN_PLACE : profile.seconds,
+          profile.seconds, parameters.num_days * NUM_PHASES, MPI_DOUBLE,
+          MPI_MAX, 0, MPI_COMM_WORLD);
+      MPI_Reduce((parameters.rank == 0) ? MPI_IN_PLACE : &profile.total_seconds,
+          &profile.total_seconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      MPI_Reduce((parameters.rank == 0) ? MPI_IN_PLACE
+          : &profile.susceptible_searches, &profile.susceptible_searches, 1,
+          MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      MPI_Reduce((parameters.rank == 0) ? MPI_IN_PLACE : &profile.pair_checks,
+          &profile.pair_checks, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
     }
-
-    /* For each person, do the following */
-    for(i = 0; i < num_people; i++)
+#endif
+    if(profile_file != NULL)
     {
-      /* If the person is infected, then */
-      if(states[i] == INFECTED)
-      {
-        /* Increment the number of days the person has been infected */
-        days_infected[i]++;
-      }
+      write_profile(profile_file, &parameters, &profile, &counts);
+      fclose(profile_file);
     }
+    free(profile.seconds);
+  }
+
+  /* Close the statistics file */
+  if(parameters.stats_file != NULL)
+  {
+    fclose(parameters.stats_file);
   }
 
-  printf("Final counts: %d susceptible, %d infected, %d immune, \
+  if(parameters.rank == 0)
+  {
+    printf("Random seed: %llu\n", (unsigned long long)parameters.seed);
+    printf("Final counts: %d susceptible, %d infected, %d immune, \
       %d dead\nActual contagiousness: %f\nActual deadliness: \
-      %f\n", num_susceptible, num_infected, num_immune, 
-      num_dead, 100.0 * (num_infections / 
-        (infection_attempts == 0 ? 1 : infection_attempts)),
-      100.0 * (num_deaths / (recovery_attempts == 0 ? 1 
-          : recovery_attempts)));
-
-  /* Deallocate the arrays -- we have finished using the memory, so now we
-   *  "free" it back to the heap */
-  for(y = env_height - 1; y >= 0; y--)
-  {
-    free(environment[y]);
-  }
-  free(environment);
-  free(states);
-  free(days_infected);
-  free(infected_ys);
-  free(infected_xs);
-  free(ys);
-  free(xs);
+      %f\n", counts.num_susceptible, counts.num_infected, counts.num_immune, 
+        counts.num_dead, 100.0 * (counts.num_infections / 
+          (counts.infection_attempts == 0 ? 1 : counts.infection_attempts)),
+        100.0 * (counts.num_deaths / (counts.recovery_attempts == 0 ? 1 
+            : counts.recovery_attempts)));
+  }
+
+  /* Deallocate the arrays */
+  free_population(&population);
+
+#ifdef _MPI
+  MPI_Finalize();
+#endif
 
   /* The program has finished executing successfully */
   return 0;
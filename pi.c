@@ -1,37 +1,840 @@
-/* Approximate pi using a Left Riemann Sum under a quarter unit circle. */
+/* Approximate pi by integrating under a quarter unit circle, using a Left
+   Riemann Sum or a higher-order quadrature method. */
 
 /* Author: Aaron Weeden, Shodor, 2015 */
 
+/* Build: gcc -O2 -fopenmp pi.c -o pi -lm
+   With MPI: mpicc -O2 -fopenmp -D_MPI pi.c -o pi -lm */
+
 #include <float.h>   /* DBL_EPSILON, DBL_DIG */
 #include <math.h>    /* sqrt() */
+#include <omp.h>     /* omp_get_max_threads(), omp_get_wtime() */
 #include <stdbool.h> /* bool type */
+#include <stdint.h>  /* uint64_t */
 #include <stdio.h>   /* fprintf(), printf() */
 #include <stdlib.h>  /* atoi(), atof(), exit(), EXIT_FAILURE */
+#include <string.h>  /* strcmp() */
 #include <getopt.h>  /* getopt(), optarg */
+#include <immintrin.h> /* AVX2 and AVX-512 intrinsics */
+#ifdef _MPI
+#include <mpi.h>     /* MPI -- build with mpicc -D_MPI */
+#endif
 
 /* Define default number of rectangles */
 #define RECTS_PER_SIM_DEFAULT 10
 
 /* Define description of input parameter for number of rectangles */
 #define RECTS_PER_SIM_DESCR \
-  "This many rectangles will be used (positive integer)"
+  "This many rectangles (intervals) will be used, or, with a tolerance, " \
+  "started from (positive integer)"
 
 /* Define character used on the command line to change the number of
    rectangles */
 #define RECTS_PER_SIM_CHAR 'r'
 
+/* Define default number of threads (0 means one per core) */
+#define NUM_THREADS_DEFAULT 0
+
+/* Define description of input parameter for number of threads */
+#define NUM_THREADS_DESCR \
+  "This many threads will sum the rectangles (positive integer, or 0 for " \
+  "one per core)"
+
+/* Define character used on the command line to change the number of
+   threads */
+#define NUM_THREADS_CHAR 't'
+
+/* Define default kernel */
+#define KERNEL_DEFAULT "auto"
+
+/* Define description of input parameter for kernel */
+#define KERNEL_DESCR \
+  "The rectangles will be summed with this kernel (scalar, avx2, avx512, " \
+  "or auto for the best this CPU supports)"
+
+/* Define character used on the command line to change the kernel */
+#define KERNEL_CHAR 'k'
+
+/* Define default summation strategy */
+#define STRATEGY_DEFAULT "naive"
+
+/* Define description of input parameter for summation strategy */
+#define STRATEGY_DESCR \
+  "The areas will be added with this strategy (naive, neumaier, pairwise, " \
+  "doubledouble, or all to compare each one's error and time)"
+
+/* Define character used on the command line to change the summation
+   strategy */
+#define STRATEGY_CHAR 's'
+
+/* Define default integration method */
+#define METHOD_DEFAULT "left"
+
+/* Define description of input parameter for integration method */
+#define METHOD_DESCR \
+  "The quarter circle will be integrated with this method (left, midpoint, " \
+  "trapezoid, simpson, romberg, gauss, or adaptive, which needs a tolerance)"
+
+/* Define character used on the command line to change the integration
+   method */
+#define METHOD_CHAR 'm'
+
+/* Define default tolerance (0 means use exactly the given number of
+   rectangles) */
+#define TOLERANCE_DEFAULT 0.0
+
+/* Define description of input parameter for tolerance */
+#define TOLERANCE_DESCR \
+  "The number of rectangles will be doubled until pi's estimated error is " \
+  "within this (non-negative number, or 0 to use exactly the given number)"
+
+/* Define character used on the command line to change the tolerance */
+#define TOLERANCE_CHAR 'e'
+
 /* Define options string used by getopt() - a colon after the character means
    the parameter's value is specified by the user */
 char const GETOPT_STRING[] = {
-  RECTS_PER_SIM_CHAR, ':'
+  RECTS_PER_SIM_CHAR, ':',
+  NUM_THREADS_CHAR, ':',
+  KERNEL_CHAR, ':',
+  STRATEGY_CHAR, ':',
+  METHOD_CHAR, ':',
+  TOLERANCE_CHAR, ':',
+  '\0'
+};
+
+/* Define number of rectangles in each chunk. The rectangles are summed a
+   chunk at a time, each chunk by whichever thread is free, and the chunks'
+   sums are then added in order, so the result is the same for any number of
+   threads. */
+#define RECTS_PER_CHUNK (1ULL << 20)
+
+/* Define number of rectangles whose areas are calculated at a time, before
+   being handed to the summation strategy; a block's areas fit in L1 cache */
+#define RECTS_PER_BLOCK 1024
+
+/* Calculate the height of the quarter unit circle at x */
+static inline double circleHeight(double const x) {
+  /* Use the circle equation to calculate the height squared */
+  double const heightSq = 1.0 - x * x;
+
+  /* If the height squared is so close to zero that the sqrt() function would
+     return -inf, do not call the sqrt() function, just set the height to zero
+     */
+  return (heightSq < DBL_EPSILON) ? 0.0 : sqrt(heightSq);
+}
+
+/* Calculate the areas of count rectangles starting at index first, each of
+   the given width, whose heights are taken offset rectangles into them (0 at
+   their left sides, 0.5 at their midpoints) */
+void rectAreas(uint64_t const first, uint64_t const count,
+    double const offset, double const width, double * const areas) {
+  for (uint64_t i = 0; i < count; i++) {
+    /* Calculate the x-coordinate at which to take the rectangle's height */
+    double const x = ((first + i) + offset) * width;
+
+    /* Calculate the area of the rectangle */
+    areas[i] = width * circleHeight(x);
+  }
+}
+
+/* Calculate the areas of rectangles as rectAreas() does, 4 at a time with
+   AVX2 or 8 at a time with AVX-512. The rectangles' indexes are kept as
+   doubles, which are exact up to 2^53, and stepped a vector at a time, and the
+   offset is added to them afresh each time, so each x is exactly the scalar x.
+   Heights squared below DBL_EPSILON are masked to zero rather than branched
+   around, and any rectangles left over are handled by rectAreas(). */
+__attribute__((target("avx2")))
+void rectAreasAvx2(uint64_t const first, uint64_t const count,
+    double const offset, double const width, double * const areas) {
+  __m256d const widths = _mm256_set1_pd(width);
+  __m256d const offsets = _mm256_set1_pd(offset);
+  __m256d const ones = _mm256_set1_pd(1.0);
+  __m256d const epsilons = _mm256_set1_pd(DBL_EPSILON);
+  __m256d const steps = _mm256_set1_pd(4.0);
+  __m256d indexes = _mm256_set_pd(first + 3, first + 2, first + 1, first);
+  uint64_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256d const x = _mm256_mul_pd(_mm256_add_pd(indexes, offsets), widths);
+    __m256d const heightSq = _mm256_sub_pd(ones, _mm256_mul_pd(x, x));
+    __m256d const height = _mm256_and_pd(_mm256_sqrt_pd(heightSq),
+        _mm256_cmp_pd(heightSq, epsilons, _CMP_GE_OQ));
+    _mm256_storeu_pd(areas + i, _mm256_mul_pd(widths, height));
+    indexes = _mm256_add_pd(indexes, steps);
+  }
+  rectAreas(first + i, count - i, offset, width, areas + i);
+}
+
+__attribute__((target("avx512f")))
+void rectAreasAvx512(uint64_t const first, uint64_t const count,
+    double const offset, double const width, double * const areas) {
+  __m512d const widths = _mm512_set1_pd(width);
+  __m512d const offsets = _mm512_set1_pd(offset);
+  __m512d const ones = _mm512_set1_pd(1.0);
+  __m512d const epsilons = _mm512_set1_pd(DBL_EPSILON);
+  __m512d const steps = _mm512_set1_pd(8.0);
+  __m512d indexes = _mm512_set_pd(first + 7, first + 6, first + 5, first + 4,
+      first + 3, first + 2, first + 1, first);
+  uint64_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m512d const x = _mm512_mul_pd(_mm512_add_pd(indexes, offsets), widths);
+    __m512d const heightSq = _mm512_sub_pd(ones, _mm512_mul_pd(x, x));
+    __mmask8 const aboveEpsilon = _mm512_cmp_pd_mask(heightSq, epsilons,
+        _CMP_GE_OQ);
+    __m512d const height = _mm512_maskz_sqrt_pd(aboveEpsilon, heightSq);
+    _mm512_storeu_pd(areas + i, _mm512_mul_pd(widths, height));
+    indexes = _mm512_add_pd(indexes, steps);
+  }
+  rectAreas(first + i, count - i, offset, width, areas + i);
+}
+
+/* Define kernels, by name; "auto" is resolved to the best the CPU supports */
+typedef void (*AreasKernel)(uint64_t, uint64_t, double, double, double *);
+
+struct Kernel {
+  char const *name;
+  AreasKernel areas;
+};
+
+struct Kernel const KERNELS[] = {
+  { "scalar", rectAreas },
+  { "avx2", rectAreasAvx2 },
+  { "avx512", rectAreasAvx512 }
+};
+
+#define NUM_KERNELS (sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+/* Define number of independent sums each summation strategy keeps. Element i
+   of the areas is always added to lane i % SUM_LANES, so the lanes have no
+   dependence between them and are added a vector at a time, and the result
+   does not depend on the kernel or the number of threads. The lanes' loops
+   are unrolled by this many (the pragma cannot take the macro), so GCC keeps
+   the lanes in registers rather than in memory. */
+#define SUM_LANES 8
+
+/* Define maximum number of levels of the pairwise strategy's tree of block
+   sums; level k holds the sum of 2^k blocks */
+#define MAX_SUM_LEVELS 64
+
+/* Define running state of a summation strategy */
+struct Sum {
+  double his[SUM_LANES];
+  double los[SUM_LANES];
+  double levels[MAX_SUM_LEVELS];
+  uint64_t numBlocks;
+};
+
+/* Define total of a summation, as an unevaluated sum hi + lo; strategies
+   without compensation leave lo at zero */
+struct Total {
+  double hi;
+  double lo;
+};
+
+/* Add a and b, returning the rounded sum and setting *error to what rounding
+   lost, exactly (Knuth's TwoSum) */
+static inline double twoSum(double const a, double const b,
+    double * const error) {
+  double const sum = a + b;
+  double const bVirtual = sum - a;
+  *error = (a - (sum - bVirtual)) + (b - bVirtual);
+  return sum;
+}
+
+/* Add b to the sum *hi, and what rounding lost to the compensation *lo,
+   whichever of the two addends is larger (Neumaier's improvement of Kahan's
+   summation, which loses the error when b is the larger) */
+static inline void addNeumaierLane(double * const hi, double * const lo,
+    double const b) {
+  double const sum = *hi + b;
+  *lo += (fabs(*hi) >= fabs(b)) ? (*hi - sum) + b : (b - sum) + *hi;
+  *hi = sum;
+}
+
+/* Add b to the double-double *hi + *lo, exactly with TwoSum, renormalizing so
+   that *lo stays below half an ulp of *hi */
+static inline void addDoubleDoubleLane(double * const hi, double * const lo,
+    double const b) {
+  double error;
+  double const sum = twoSum(*hi, b, &error);
+  error += *lo;
+  *hi = sum + error;
+  *lo = error - (*hi - sum);
+}
+
+/* Naive: add each area to its lane's sum */
+void addNaive(struct Sum * const sum, double const * const areas,
+    uint64_t const count) {
+  double his[SUM_LANES];
+  memcpy(his, sum->his, sizeof(his));
+  uint64_t i = 0;
+  for (; i + SUM_LANES <= count; i += SUM_LANES) {
+#pragma GCC unroll 8
+    for (int lane = 0; lane < SUM_LANES; lane++) {
+      his[lane] += areas[i + lane];
+    }
+  }
+  for (int lane = 0; i + lane < count; lane++) {
+    his[lane] += areas[i + lane];
+  }
+  memcpy(sum->his, his, sizeof(his));
+}
+
+struct Total totalNaive(struct Sum const * const sum) {
+  struct Total total = { 0.0, 0.0 };
+  for (int lane = 0; lane < SUM_LANES; lane++) {
+    total.hi += sum->his[lane];
+  }
+  return total;
+}
+
+/* Neumaier: add each area to its lane's sum, and what rounding lost to the
+   lane's compensation, which is added to the sum only at the end */
+void addNeumaier(struct Sum * const sum, double const * const areas,
+    uint64_t const count) {
+  double his[SUM_LANES];
+  double los[SUM_LANES];
+  memcpy(his, sum->his, sizeof(his));
+  memcpy(los, sum->los, sizeof(los));
+  uint64_t i = 0;
+  for (; i + SUM_LANES <= count; i += SUM_LANES) {
+#pragma GCC unroll 8
+    for (int lane = 0; lane < SUM_LANES; lane++) {
+      addNeumaierLane(&his[lane], &los[lane], areas[i + lane]);
+    }
+  }
+  for (int lane = 0; i + lane < count; lane++) {
+    addNeumaierLane(&his[lane], &los[lane], areas[i + lane]);
+  }
+  memcpy(sum->his, his, sizeof(his));
+  memcpy(sum->los, los, sizeof(los));
+}
+
+struct Total totalNeumaier(struct Sum const * const sum) {
+  struct Total total = { 0.0, 0.0 };
+  for (int lane = 0; lane < SUM_LANES; lane++) {
+    addNeumaierLane(&total.hi, &total.lo, sum->his[lane]);
+    total.lo += sum->los[lane];
+  }
+  return total;
+}
+
+/* Pairwise: sum each block of up to RECTS_PER_BLOCK areas in lanes, add the
+   lanes in pairs, and merge the block's sum into a binary tree of block sums,
+   so each area passes through O(log n) additions rather than O(n) */
+void addPairwise(struct Sum * const sum, double const * const areas,
+    uint64_t const count) {
+  for (uint64_t first = 0; first < count; first += RECTS_PER_BLOCK) {
+    uint64_t const last = (count - first < RECTS_PER_BLOCK)
+      ? count : first + RECTS_PER_BLOCK;
+    double lanes[SUM_LANES] = { 0.0 };
+    uint64_t i = first;
+    for (; i + SUM_LANES <= last; i += SUM_LANES) {
+#pragma GCC unroll 8
+      for (int lane = 0; lane < SUM_LANES; lane++) {
+        lanes[lane] += areas[i + lane];
+      }
+    }
+    for (int lane = 0; i + lane < last; lane++) {
+      lanes[lane] += areas[i + lane];
+    }
+    for (int width = SUM_LANES / 2; width > 0; width /= 2) {
+      for (int lane = 0; lane < width; lane++) {
+        lanes[lane] += lanes[lane + width];
+      }
+    }
+
+    /* Merge the block's sum with each full level below the first empty one,
+       as in incrementing a binary counter */
+    double blockSum = lanes[0];
+    int level = 0;
+    for (uint64_t blocks = sum->numBlocks; blocks & 1; blocks >>= 1) {
+      blockSum = sum->levels[level] + blockSum;
+      level++;
+    }
+    sum->levels[level] = blockSum;
+    sum->numBlocks++;
+  }
+}
+
+struct Total totalPairwise(struct Sum const * const sum) {
+  struct Total total = { 0.0, 0.0 };
+  for (int level = 0; level < MAX_SUM_LEVELS; level++) {
+    if (sum->numBlocks & (1ULL << level)) {
+      total.hi += sum->levels[level];
+    }
+  }
+  return total;
+}
+
+/* Double-double: keep each lane's sum as an unevaluated hi + lo carrying
+   about 106 bits */
+void addDoubleDouble(struct Sum * const sum, double const * const areas,
+    uint64_t const count) {
+  double his[SUM_LANES];
+  double los[SUM_LANES];
+  memcpy(his, sum->his, sizeof(his));
+  memcpy(los, sum->los, sizeof(los));
+  uint64_t i = 0;
+  for (; i + SUM_LANES <= count; i += SUM_LANES) {
+#pragma GCC unroll 8
+    for (int lane = 0; lane < SUM_LANES; lane++) {
+      addDoubleDoubleLane(&his[lane], &los[lane], areas[i + lane]);
+    }
+  }
+  for (int lane = 0; i + lane < count; lane++) {
+    addDoubleDoubleLane(&his[lane], &los[lane], areas[i + lane]);
+  }
+  memcpy(sum->his, his, sizeof(his));
+  memcpy(sum->los, los, sizeof(los));
+}
+
+struct Total totalDoubleDouble(struct Sum const * const sum) {
+  struct Total total = { 0.0, 0.0 };
+  for (int lane = 0; lane < SUM_LANES; lane++) {
+    addDoubleDoubleLane(&total.hi, &total.lo, sum->his[lane]);
+    addDoubleDoubleLane(&total.hi, &total.lo, sum->los[lane]);
+  }
+  return total;
+}
+
+/* Define summation strategies, by name; "all" compares them */
+struct Strategy {
+  char const *name;
+  void (*add)(struct Sum *, double const *, uint64_t);
+  struct Total (*total)(struct Sum const *);
+};
+
+struct Strategy const STRATEGIES[] = {
+  { "naive", addNaive, totalNaive },
+  { "neumaier", addNeumaier, totalNeumaier },
+  { "pairwise", addPairwise, totalPairwise },
+  { "doubledouble", addDoubleDouble, totalDoubleDouble }
+};
+
+#define NUM_STRATEGIES (sizeof(STRATEGIES) / sizeof(STRATEGIES[0]))
+
+/* Sum the areas of rectangles first up to (not including) last, each of the
+   given width and with its height taken offset rectangles into it, a block at
+   a time */
+struct Total sumRects(struct Kernel const *kernel,
+    struct Strategy const *strategy, uint64_t const first,
+    uint64_t const last, double const offset, double const width) {
+  double areas[RECTS_PER_BLOCK];
+  struct Sum sum;
+  memset(&sum, 0, sizeof(sum));
+  for (uint64_t i = first; i < last; i += RECTS_PER_BLOCK) {
+    uint64_t const count = (last - i < RECTS_PER_BLOCK)
+      ? last - i : RECTS_PER_BLOCK;
+    kernel->areas(i, count, offset, width, areas);
+    strategy->add(&sum, areas, count);
+  }
+  return strategy->total(&sum);
+}
+
+/* Sum the areas of rectangles first up to (not including) last, each chunk
+   of them in parallel, and add the chunks' totals in order with the same
+   strategy */
+struct Total sumAllRects(struct Kernel const *kernel,
+    struct Strategy const *strategy, uint64_t const first,
+    uint64_t const last, double const offset, double const width) {
+  uint64_t const numChunks = (last - first + RECTS_PER_CHUNK - 1)
+    / RECTS_PER_CHUNK;
+  double * const chunkHis = malloc(2 * numChunks * sizeof(double));
+  if (chunkHis == NULL) {
+    fprintf(stderr, "ERROR: cannot allocate sums of %llu chunks\n",
+        (unsigned long long)numChunks);
+    exit(EXIT_FAILURE);
+  }
+  double * const chunkLos = chunkHis + numChunks;
+#pragma omp parallel for schedule(dynamic)
+  for (uint64_t chunk = 0; chunk < numChunks; chunk++) {
+    uint64_t const chunkFirst = first + chunk * RECTS_PER_CHUNK;
+    uint64_t const chunkLast = (last - chunkFirst > RECTS_PER_CHUNK)
+      ? chunkFirst + RECTS_PER_CHUNK : last;
+    struct Total const total = sumRects(kernel, strategy, chunkFirst,
+        chunkLast, offset, width);
+    chunkHis[chunk] = total.hi;
+    chunkLos[chunk] = total.lo;
+  }
+  struct Sum sum;
+  memset(&sum, 0, sizeof(sum));
+  strategy->add(&sum, chunkHis, numChunks);
+  strategy->add(&sum, chunkLos, numChunks);
+  free(chunkHis);
+  return strategy->total(&sum);
+}
+
+/* Define tolerance of a vector kernel's sum of a chunk, relative to the
+   scalar sum: the kernels add areas in the same order, so they can only
+   differ by rounding in each area (e.g. x*x contracted into an FMA), a few
+   ulps or about DBL_EPSILON of it, over RECTS_PER_CHUNK areas */
+#define KERNEL_TOLERANCE (RECTS_PER_CHUNK * DBL_EPSILON)
+
+/* Return whether a kernel's sum of rectangles first up to last is within
+   KERNEL_TOLERANCE of the scalar reference's, printing both if not */
+bool matchesScalar(struct Kernel const *kernel,
+    struct Strategy const *strategy, uint64_t const first,
+    uint64_t const last, double const width) {
+  struct Total const referenceTotal = sumRects(&KERNELS[0], strategy, first,
+      last, 0.0, width);
+  struct Total const total = sumRects(kernel, strategy, first, last, 0.0,
+      width);
+  double const reference = referenceTotal.hi + referenceTotal.lo;
+  double const sum = total.hi + total.lo;
+  if (fabs(sum - reference) > KERNEL_TOLERANCE * fabs(reference)) {
+    fprintf(stderr, "ERROR: %s kernel's sum of rectangles %llu to %llu is "
+        "%.*e, but the scalar sum is %.*e\n", kernel->name,
+        (unsigned long long)first, (unsigned long long)last, DBL_DIG + 1,
+        sum, DBL_DIG + 1, reference);
+    return false;
+  }
+  return true;
+}
+
+/* Define state shared by the integration methods: how to sum rectangles and
+   which of them this process sums, how many heights have been calculated and
+   how long that and collecting the processes' sums took, and the sums kept so
+   that an estimate over twice as many intervals can reuse them */
+#define MAX_ROMBERG_LEVELS 64
+
+struct Integrator {
+  struct Kernel const *kernel;
+  struct Strategy const *strategy;
+  int rank;
+  int numRanks;
+  double tolerance;
+  double error;
+  uint64_t intervals;
+  uint64_t evaluations;
+  uint64_t localEvaluations;
+  double computeSeconds;
+  double reduceSeconds;
+  uint64_t trapezoidIntervals;
+  struct Total trapezoid;
+  uint64_t rombergIntervals;
+  int rombergLevel;
+  double romberg[MAX_ROMBERG_LEVELS];
 };
 
+/* Add double-double b to double-double a */
+static inline struct Total addTotals(struct Total const a,
+    struct Total const b) {
+  double error;
+  double const sum = twoSum(a.hi, b.hi, &error);
+  error += a.lo + b.lo;
+  double const hi = sum + error;
+  return (struct Total){ hi, error - (hi - sum) };
+}
+
+/* Multiply double-double a by b */
+static inline struct Total scaleTotal(struct Total const a, double const b) {
+  double const product = a.hi * b;
+  double const error = fma(a.hi, b, -product) + a.lo * b;
+  double const hi = product + error;
+  return (struct Total){ hi, error - (hi - product) };
+}
+
+#ifdef _MPI
+/* Add the processes' totals up a binary tree, process r adding the total of
+   process r + step to its own at each step, so the order of the additions
+   depends only on the number of processes, not on which messages arrive
+   first as MPI_Allreduce() allows; then send the sum back to all of them */
+struct Total reduceTotals(struct Total total, int const rank,
+    int const numRanks) {
+  for (int step = 1; step < numRanks; step *= 2) {
+    if (rank % (2 * step) != 0) {
+      double const pair[2] = { total.hi, total.lo };
+      MPI_Send(pair, 2, MPI_DOUBLE, rank - step, 0, MPI_COMM_WORLD);
+      break;
+    }
+    if (rank + step < numRanks) {
+      double pair[2];
+      MPI_Recv(pair, 2, MPI_DOUBLE, rank + step, 0, MPI_COMM_WORLD,
+          MPI_STATUS_IGNORE);
+      total = addTotals(total, (struct Total){ pair[0], pair[1] });
+    }
+  }
+  double pair[2] = { total.hi, total.lo };
+  MPI_Bcast(pair, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  return (struct Total){ pair[0], pair[1] };
+}
+#endif
+
+/* Sum the areas of rectangles dividing [0, 1] into intervals, each with its
+   height taken offset rectangles into it. Each process sums a contiguous
+   share of the rectangles, the first intervals % numRanks shares one
+   rectangle larger than the rest, chunking its share itself, and the
+   processes' sums are then added together. */
+struct Total gridSum(struct Integrator * const integrator,
+    uint64_t const intervals, double const offset) {
+  uint64_t const share = intervals / integrator->numRanks;
+  uint64_t const extra = intervals % integrator->numRanks;
+  uint64_t const rank = integrator->rank;
+  uint64_t const first = share * rank + ((rank < extra) ? rank : extra);
+  uint64_t const last = first + share + ((rank < extra) ? 1 : 0);
+  double const startTime = omp_get_wtime();
+  struct Total total = { 0.0, 0.0 };
+  if (first < last) {
+    total = sumAllRects(integrator->kernel, integrator->strategy, first, last,
+        offset, (double)1 / intervals);
+  }
+  integrator->computeSeconds += omp_get_wtime() - startTime;
+  integrator->evaluations += intervals;
+  integrator->localEvaluations += last - first;
+#ifdef _MPI
+  if (integrator->numRanks > 1) {
+    double const reduceStartTime = omp_get_wtime();
+    total = reduceTotals(total, integrator->rank, integrator->numRanks);
+    integrator->reduceSeconds += omp_get_wtime() - reduceStartTime;
+  }
+#endif
+  return total;
+}
+
+/* Left Riemann sum: heights at each interval's left side; error O(h) */
+struct Total leftRiemann(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  return gridSum(integrator, intervals, 0.0);
+}
+
+/* Midpoint rule: heights at each interval's midpoint; error O(h^2) for smooth
+   integrands */
+struct Total midpoint(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  return gridSum(integrator, intervals, 0.5);
+}
+
+/* Trapezoid rule: the average of the left and right Riemann sums; error
+   O(h^2) for smooth integrands. Halving the previous estimate's intervals adds
+   only their midpoints, so that is all that is calculated. */
+struct Total trapezoid(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  if (integrator->trapezoidIntervals == intervals) {
+    return integrator->trapezoid;
+  }
+  if (integrator->trapezoidIntervals > 0
+      && integrator->trapezoidIntervals * 2 == intervals) {
+    integrator->trapezoid = scaleTotal(addTotals(integrator->trapezoid,
+          midpoint(integrator, intervals / 2)), 0.5);
+  } else {
+    integrator->evaluations += 2;
+    integrator->trapezoid = addTotals(leftRiemann(integrator, intervals),
+        (struct Total){ (circleHeight(1.0) - circleHeight(0.0)) / 2.0
+          / intervals, 0.0 });
+  }
+  integrator->trapezoidIntervals = intervals;
+  return integrator->trapezoid;
+}
+
+/* Simpson's rule: (trapezoid + 2 * midpoint) / 3, which cancels their O(h^2)
+   errors; error O(h^4) for smooth integrands. The average of the two is the
+   trapezoid sum over twice as many intervals, kept for the next estimate. */
+struct Total simpson(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  struct Total const trapezoidSum = trapezoid(integrator, intervals);
+  struct Total const midpointSum = midpoint(integrator, intervals);
+  integrator->trapezoid = scaleTotal(addTotals(trapezoidSum, midpointSum),
+      0.5);
+  integrator->trapezoidIntervals = 2 * intervals;
+  return scaleTotal(addTotals(trapezoidSum, scaleTotal(midpointSum, 2.0)),
+      1.0 / 3.0);
+}
+
+/* Add a row to the Romberg table from the trapezoid sum over intervals,
+   twice as many as the last row's, extrapolating away its error terms of
+   order h^2, h^4, ... one column at a time */
+void extendRomberg(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  struct Total const trapezoidSum = trapezoid(integrator, intervals);
+  int const level = ++integrator->rombergLevel;
+  double * const row = integrator->romberg;
+  double above = row[0];
+  row[0] = trapezoidSum.hi + trapezoidSum.lo;
+  double factor = 1.0;
+  for (int column = 1; column <= level; column++) {
+    factor *= 4.0;
+    double const next = row[column - 1]
+      + (row[column - 1] - above) / (factor - 1.0);
+    above = row[column];
+    row[column] = next;
+  }
+  integrator->rombergIntervals = intervals;
+}
+
+/* Romberg integration: Richardson extrapolation of the trapezoid sums over
+   intervals, half as many, a quarter as many, and so on while the number
+   stays whole. The integrand's derivative is infinite at x = 1, so its error
+   is not the O(h^2) series the extrapolation assumes and it gains little over
+   the trapezoid rule here. */
+struct Total romberg(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  if (integrator->rombergIntervals == 0
+      || integrator->rombergIntervals * 2 != intervals) {
+    uint64_t first = intervals;
+    while (first % 2 == 0) {
+      first /= 2;
+    }
+    integrator->rombergLevel = -1;
+    for (uint64_t halved = first; halved < intervals; halved *= 2) {
+      extendRomberg(integrator, halved);
+    }
+  }
+  extendRomberg(integrator, intervals);
+  return (struct Total){ integrator->romberg[integrator->rombergLevel], 0.0 };
+}
+
+/* Define nodes on [-1, 1] and weights of 5-point Gauss-Legendre quadrature,
+   which is exact for polynomials up to degree 9 */
+#define GAUSS_POINTS 5
+
+double const GAUSS_NODES[GAUSS_POINTS] = {
+  -0.90617984593866399280, -0.53846931010568309104, 0.0,
+  0.53846931010568309104, 0.90617984593866399280
+};
+
+double const GAUSS_WEIGHTS[GAUSS_POINTS] = {
+  0.23692688505618908751, 0.47862867049936646804, 0.56888888888888888889,
+  0.47862867049936646804, 0.23692688505618908751
+};
+
+/* Composite Gauss-Legendre quadrature: each node is at the same offset into
+   every interval, so each node's heights are one more sum of rectangles */
+struct Total gaussLegendre(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  struct Total sum = { 0.0, 0.0 };
+  for (int point = 0; point < GAUSS_POINTS; point++) {
+    sum = addTotals(sum, scaleTotal(gridSum(integrator, intervals,
+            (1.0 + GAUSS_NODES[point]) / 2.0), GAUSS_WEIGHTS[point] / 2.0));
+  }
+  return sum;
+}
+
+/* Define deepest the adaptive method will subdivide; an interval 2^-50 wide
+   is within a few ulps of x = 1 */
+#define MAX_ADAPTIVE_DEPTH 50
+
+/* Integrate over [a, b], given the heights at a, its midpoint and b and
+   Simpson's estimate from them, by comparing that with Simpson's estimates
+   over its halves, and subdividing those that differ by more than the
+   tolerance. The intervals near x = 1, where the height's derivative is
+   infinite, are the ones that are subdivided most. */
+double adaptiveStep(struct Integrator * const integrator, double const a,
+    double const b, double const heightA, double const heightMiddle,
+    double const heightB, double const whole, double const tolerance,
+    int const depth) {
+  double const middle = (a + b) / 2.0;
+  double const heightLeft = circleHeight((a + middle) / 2.0);
+  double const heightRight = circleHeight((middle + b) / 2.0);
+  integrator->evaluations += 2;
+  double const left = (middle - a) / 6.0
+    * (heightA + 4.0 * heightLeft + heightMiddle);
+  double const right = (b - middle) / 6.0
+    * (heightMiddle + 4.0 * heightRight + heightB);
+  double const delta = left + right - whole;
+
+  /* Simpson's error is about a 15th of the change, which is also added to
+     correct the estimate */
+  if (depth >= MAX_ADAPTIVE_DEPTH || fabs(delta) <= 15.0 * tolerance) {
+    integrator->intervals += 2;
+    integrator->error += fabs(delta) / 15.0;
+    return left + right + delta / 15.0;
+  }
+  return adaptiveStep(integrator, a, middle, heightA, heightLeft,
+      heightMiddle, left, tolerance / 2.0, depth + 1)
+    + adaptiveStep(integrator, middle, b, heightMiddle, heightRight, heightB,
+        right, tolerance / 2.0, depth + 1);
+}
+
+/* Adaptive Simpson's rule over [0, 1] to the integrator's tolerance; the
+   number of intervals is chosen by the method, not given to it */
+struct Total adaptiveSimpson(struct Integrator * const integrator,
+    uint64_t const intervals) {
+  (void)intervals;
+  double const height0 = circleHeight(0.0);
+  double const heightHalf = circleHeight(0.5);
+  double const height1 = circleHeight(1.0);
+  integrator->evaluations += 3;
+  integrator->intervals = 0;
+  integrator->error = 0.0;
+  return (struct Total){ adaptiveStep(integrator, 0.0, 1.0, height0,
+      heightHalf, height1, (height0 + 4.0 * heightHalf + height1) / 6.0,
+      integrator->tolerance, 0), 0.0 };
+}
+
+/* Define integration methods, by name */
+struct Method {
+  char const *name;
+  struct Total (*integrate)(struct Integrator *, uint64_t);
+};
+
+struct Method const METHODS[] = {
+  { "left", leftRiemann },
+  { "midpoint", midpoint },
+  { "trapezoid", trapezoid },
+  { "simpson", simpson },
+  { "romberg", romberg },
+  { "gauss", gaussLegendre },
+  { "adaptive", adaptiveSimpson }
+};
+
+#define NUM_METHODS (sizeof(METHODS) / sizeof(METHODS[0]))
+
+/* Define largest number of intervals; beyond 2^53 the rectangles' indexes
+   are no longer exact as doubles */
+#define MAX_INTERVALS (1ULL << 53)
+
+/* Integrate with the method over the given number of intervals or, if the
+   integrator has a tolerance, over twice as many each time from there until
+   two estimates differ by no more than it, which is then the estimated error
+   of the first of them and overstates that of the second */
+struct Total integrate(struct Method const *method,
+    struct Integrator * const integrator, uint64_t intervals) {
+  struct Total estimate = method->integrate(integrator, intervals);
+  if (method->integrate == adaptiveSimpson) {
+    return estimate;
+  }
+  integrator->error = NAN;
+  if (integrator->tolerance > 0.0) {
+    do {
+      if (intervals > MAX_INTERVALS / 2) {
+        fprintf(stderr, "ERROR: the %s method cannot reach an error of %e "
+            "in pi with %llu intervals or fewer\n", method->name,
+            4.0 * integrator->tolerance, (unsigned long long)MAX_INTERVALS);
+        exit(EXIT_FAILURE);
+      }
+      intervals *= 2;
+      struct Total const previous = estimate;
+      estimate = method->integrate(integrator, intervals);
+      integrator->error = fabs((estimate.hi - previous.hi)
+          + (estimate.lo - previous.lo));
+    } while (integrator->error > integrator->tolerance);
+  }
+  integrator->intervals = intervals;
+  return estimate;
+}
+
 int main(int argc, char **argv) {
   bool isError = false;
 
+  /* Start MPI; only the main thread calls it */
+  int rank = 0;
+  int numRanks = 1;
+#ifdef _MPI
+  int threadSupport;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+#endif
+
   /* Get user options for number of rectangles */
   unsigned long long int rectsPerSim = RECTS_PER_SIM_DEFAULT;
-  char c;
+  int numThreads = NUM_THREADS_DEFAULT;
+  char const *kernelName = KERNEL_DEFAULT;
+  char const *strategyName = STRATEGY_DEFAULT;
+  char const *methodName = METHOD_DEFAULT;
+  double tolerance = TOLERANCE_DEFAULT;
+  int c;
   while ((c = getopt(argc, argv, GETOPT_STRING)) != -1) {
     switch(c) {
       /* The user has chosen to change the number of rectangles */
@@ -45,6 +848,40 @@ int main(int argc, char **argv) {
           isError = true;
         }
         break;
+        /* The user has chosen to change the number of threads */
+      case NUM_THREADS_CHAR:
+        /* Get integer value */
+        numThreads = atoi(optarg);
+        /* Make sure not negative */
+        if (numThreads < 0) {
+          fprintf(stderr, "ERROR: value for -%c must be non-negative integer\n",
+              NUM_THREADS_CHAR);
+          isError = true;
+        }
+        break;
+        /* The user has chosen to change the kernel */
+      case KERNEL_CHAR:
+        kernelName = optarg;
+        break;
+        /* The user has chosen to change the summation strategy */
+      case STRATEGY_CHAR:
+        strategyName = optarg;
+        break;
+        /* The user has chosen to change the integration method */
+      case METHOD_CHAR:
+        methodName = optarg;
+        break;
+        /* The user has chosen to change the tolerance */
+      case TOLERANCE_CHAR:
+        /* Get floating point value */
+        tolerance = atof(optarg);
+        /* Make sure not negative */
+        if (tolerance < 0.0) {
+          fprintf(stderr, "ERROR: value for -%c must be non-negative number\n",
+              TOLERANCE_CHAR);
+          isError = true;
+        }
+        break;
         /* The user has chosen an unknown option */
       default:
         isError = true;
@@ -58,33 +895,226 @@ int main(int argc, char **argv) {
     fprintf(stderr, "Where OPTIONS can be any of the following:\n");
     fprintf(stderr, "-%c : \n\t%s\n\tdefault: %d\n", RECTS_PER_SIM_CHAR,
         RECTS_PER_SIM_DESCR, RECTS_PER_SIM_DEFAULT);
+    fprintf(stderr, "-%c : \n\t%s\n\tdefault: %d\n", NUM_THREADS_CHAR,
+        NUM_THREADS_DESCR, NUM_THREADS_DEFAULT);
+    fprintf(stderr, "-%c : \n\t%s\n\tdefault: %s\n", KERNEL_CHAR,
+        KERNEL_DESCR, KERNEL_DEFAULT);
+    fprintf(stderr, "-%c : \n\t%s\n\tdefault: %s\n", STRATEGY_CHAR,
+        STRATEGY_DESCR, STRATEGY_DEFAULT);
+    fprintf(stderr, "-%c : \n\t%s\n\tdefault: %s\n", METHOD_CHAR,
+        METHOD_DESCR, METHOD_DEFAULT);
+    fprintf(stderr, "-%c : \n\t%s\n\tdefault: %g\n", TOLERANCE_CHAR,
+        TOLERANCE_DESCR, TOLERANCE_DEFAULT);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Choose the kernel, making sure this CPU supports it */
+  __builtin_cpu_init();
+  if (strcmp(kernelName, "auto") == 0) {
+    kernelName = __builtin_cpu_supports("avx512f") ? "avx512"
+      : __builtin_cpu_supports("avx2") ? "avx2" : "scalar";
+  }
+  struct Kernel const *kernel = NULL;
+  for (size_t k = 0; k < NUM_KERNELS; k++) {
+    if (strcmp(kernelName, KERNELS[k].name) == 0) {
+      kernel = &KERNELS[k];
+    }
+  }
+  if (kernel == NULL) {
+    fprintf(stderr, "ERROR: value for -%c must be scalar, avx2, avx512 or "
+        "auto\n", KERNEL_CHAR);
+    exit(EXIT_FAILURE);
+  }
+  if ((kernel->areas == rectAreasAvx2 && !__builtin_cpu_supports("avx2"))
+      || (kernel->areas == rectAreasAvx512
+        && !__builtin_cpu_supports("avx512f"))) {
+    fprintf(stderr, "ERROR: this CPU does not support the %s kernel\n",
+        kernel->name);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Choose the summation strategy, or all of them to compare */
+  bool const compareStrategies = (strcmp(strategyName, "all") == 0);
+  struct Strategy const *strategy = compareStrategies ? &STRATEGIES[0] : NULL;
+  for (size_t s = 0; s < NUM_STRATEGIES; s++) {
+    if (strcmp(strategyName, STRATEGIES[s].name) == 0) {
+      strategy = &STRATEGIES[s];
+    }
+  }
+  if (strategy == NULL) {
+    fprintf(stderr, "ERROR: value for -%c must be naive, neumaier, pairwise, "
+        "doubledouble or all\n", STRATEGY_CHAR);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Choose the integration method; the adaptive method chooses its own
+     intervals, so it needs a tolerance to do so */
+  struct Method const *method = NULL;
+  for (size_t m = 0; m < NUM_METHODS; m++) {
+    if (strcmp(methodName, METHODS[m].name) == 0) {
+      method = &METHODS[m];
+    }
+  }
+  if (method == NULL) {
+    fprintf(stderr, "ERROR: value for -%c must be left, midpoint, trapezoid, "
+        "simpson, romberg, gauss or adaptive\n", METHOD_CHAR);
     exit(EXIT_FAILURE);
   }
+  bool const sumsRects = (method->integrate != adaptiveSimpson);
+  if (!sumsRects && tolerance == 0.0) {
+    fprintf(stderr, "ERROR: the adaptive method needs a tolerance (-%c)\n",
+        TOLERANCE_CHAR);
+    exit(EXIT_FAILURE);
+  }
+  if (!sumsRects && compareStrategies) {
+    fprintf(stderr, "ERROR: the adaptive method sums no rectangles, so it has "
+        "no strategies to compare\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Use the chosen number of threads */
+  if (numThreads > 0) {
+    omp_set_num_threads(numThreads);
+  }
+  numThreads = omp_get_max_threads();
 
   /* Calculate the width of each rectangle */
   double const width = (double)1 / rectsPerSim;
 
-  /* Sum areas of all rectangles */
-  double areaSum = 0.0;
-  for (int i = 0; i < rectsPerSim; i++) {
-    /* Calculate the x-coordinate of the rectangle's left side */
-    double const x = i * width;
+  /* Check the kernel against the scalar reference on the first and last
+     chunks, the last including the heights that are masked to zero, unless
+     the method never calls it */
+  uint64_t const numChunks = (rectsPerSim + RECTS_PER_CHUNK - 1)
+    / RECTS_PER_CHUNK;
+  if (sumsRects && kernel->areas != rectAreas
+      && (!matchesScalar(kernel, strategy, 0,
+          (rectsPerSim < RECTS_PER_CHUNK) ? rectsPerSim : RECTS_PER_CHUNK,
+          width)
+        || !matchesScalar(kernel, strategy,
+          (numChunks - 1) * RECTS_PER_CHUNK, rectsPerSim, width))) {
+    exit(EXIT_FAILURE);
+  }
 
-    /* Use the circle equation to calculate the rectangle's height squared */
-    double const heightSq = 1.0 - x * x;
+  /* Compare the strategies: time each one, and print its pi, its error
+     against pi from math.h (mostly that of the method itself, which is the
+     same for all of them), and its difference from the double-double
+     strategy's pi (mostly its rounding error) */
+  if (compareStrategies) {
+    struct Total totals[NUM_STRATEGIES];
+    uint64_t evaluations[NUM_STRATEGIES];
+    double seconds[NUM_STRATEGIES];
+    for (size_t s = 0; s < NUM_STRATEGIES; s++) {
+      struct Integrator integrator = {
+        .kernel = kernel, .strategy = &STRATEGIES[s], .rank = rank,
+        .numRanks = numRanks, .tolerance = tolerance / 4.0
+      };
+#ifdef _MPI
+      MPI_Barrier(MPI_COMM_WORLD);
+#endif
+      double const startTime = omp_get_wtime();
+      totals[s] = integrate(method, &integrator, rectsPerSim);
+      seconds[s] = omp_get_wtime() - startTime;
+      evaluations[s] = integrator.evaluations;
+    }
+    if (rank == 0) {
+      struct Total const reference = totals[NUM_STRATEGIES - 1];
+      printf("%d processes of %d threads, the %s method and the %s kernel\n",
+          numRanks, numThreads, method->name, kernel->name);
+      printf("%-12s %-*s %-13s %-13s %-12s %s\n", "strategy", DBL_DIG + 2,
+          "pi", "error", "rounding", "evaluations", "seconds");
+      for (size_t s = 0; s < NUM_STRATEGIES; s++) {
+        double const pi = 4.0 * (totals[s].hi + totals[s].lo);
+        double const rounding = 4.0 * ((totals[s].hi - reference.hi)
+            + (totals[s].lo - reference.lo));
+        printf("%-12s %.*f %+.6e %+.6e %-12llu %f\n", STRATEGIES[s].name,
+            DBL_DIG, pi, pi - M_PI, rounding,
+            (unsigned long long)evaluations[s], seconds[s]);
+      }
+    }
+#ifdef _MPI
+    MPI_Finalize();
+#endif
+    return 0;
+  }
 
-    /* If the height squared is so close to zero that the sqrt() function would
-       return -inf, do not call the sqrt() function, just set the height to zero
-       */
-    double const height = (heightSq < DBL_EPSILON) ? 0.0 : sqrt(heightSq);
+  /* Integrate, to the tolerance if there is one, starting all the processes
+     together so that their times are comparable */
+  struct Integrator integrator = {
+    .kernel = kernel, .strategy = strategy, .rank = rank,
+    .numRanks = numRanks, .tolerance = tolerance / 4.0
+  };
+#ifdef _MPI
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  double const startTime = omp_get_wtime();
+  struct Total const total = integrate(method, &integrator, rectsPerSim);
+  double const areaSum = total.hi + total.lo;
+  double const seconds = omp_get_wtime() - startTime;
 
-    /* Calculate the area of the rectangle and add it to the total */
-    areaSum += width * height;
+  /* Calculate pi and print it */
+  if (rank == 0) {
+    printf("%.*f\n", DBL_DIG, 4.0 * areaSum);
+    printf("Value of pi from math.h is %.*f\n", DBL_DIG, M_PI);
+    if (tolerance > 0.0) {
+      printf("Estimated error is %e, within the tolerance of %e\n",
+          4.0 * integrator.error, tolerance);
+    }
+    /* The adaptive method runs serially, without a kernel or strategy */
+    if (sumsRects) {
+      printf("%llu intervals and %llu evaluations in %f seconds with %d "
+          "threads, the %s method, the %s kernel and %s summation (%e "
+          "evaluations per second)\n",
+          (unsigned long long)integrator.intervals,
+          (unsigned long long)integrator.evaluations, seconds, numThreads,
+          method->name, kernel->name, strategy->name,
+          (seconds > 0.0) ? integrator.evaluations / seconds : 0.0);
+    } else {
+      printf("%llu intervals and %llu evaluations in %f seconds with the %s "
+          "method, serially (%e evaluations per second)\n",
+          (unsigned long long)integrator.intervals,
+          (unsigned long long)integrator.evaluations, seconds, method->name,
+          (seconds > 0.0) ? integrator.evaluations / seconds : 0.0);
+    }
   }
 
-  /* Calculate pi and print it */
-  printf("%.*f\n", DBL_DIG, 4.0 * areaSum);
-  printf("Value of pi from math.h is %.*f\n", DBL_DIG, M_PI);
+#ifdef _MPI
+  /* Print each process's share of the evaluations, the seconds it spent on
+     them and waiting for and adding the others' sums, and the load
+     imbalance: how much longer the slowest process computed than the average;
+     the adaptive method does all its work on every process, so it has no
+     shares to print */
+  if (numRanks > 1 && sumsRects) {
+    double const mine[3] = { (double)integrator.localEvaluations,
+      integrator.computeSeconds, integrator.reduceSeconds };
+    double * const all = (rank == 0)
+      ? malloc(3 * numRanks * sizeof(double)) : NULL;
+    if (rank == 0 && all == NULL) {
+      fprintf(stderr, "ERROR: cannot allocate times of %d processes\n",
+          numRanks);
+      exit(EXIT_FAILURE);
+    }
+    MPI_Gather(mine, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+      double maxSeconds = 0.0;
+      double sumSeconds = 0.0;
+      printf("%-7s %-14s %-14s %s\n", "process", "evaluations",
+          "compute (s)", "reduce (s)");
+      for (int r = 0; r < numRanks; r++) {
+        printf("%-7d %-14.0f %-14f %f\n", r, all[3 * r], all[3 * r + 1],
+            all[3 * r + 2]);
+        maxSeconds = (all[3 * r + 1] > maxSeconds) ? all[3 * r + 1]
+          : maxSeconds;
+        sumSeconds += all[3 * r + 1];
+      }
+      double const meanSeconds = sumSeconds / numRanks;
+      printf("Load imbalance is %.1f%% (slowest %f seconds, average %f "
+          "seconds)\n", (meanSeconds > 0.0)
+          ? 100.0 * (maxSeconds / meanSeconds - 1.0) : 0.0, maxSeconds,
+          meanSeconds);
+      free(all);
+    }
+  }
+  MPI_Finalize();
+#endif
   return 0;
 }
-